@@ -0,0 +1,324 @@
+// Microbenchmarks of the CPU stages of the geometry pipeline. No window or GL context is needed.
+//
+// usage: HarmonographBench [--min N] [--max N] [--stage NAME] [--csv]
+//
+// Every stage runs at 1e3, 1e4, ... curve samples up to --max and reports the time per call and per
+// sample, the bytes it produces per second and the heap allocations of one call. Stages write into
+// the buffers of the previous call, as the app does from frame to frame, so the allocations are those
+// of a warm call; only a call slower than BENCH_MIN_SECONDS runs once, cold.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+#include "meshExport.h"
+#include "parallel.h"
+
+#define BENCH_MIN_SAMPLES 1000
+#define BENCH_MAX_SAMPLES 10000000
+#define BENCH_MIN_SECONDS 0.5 // calls repeat until they have taken this long in total
+#ifdef _WIN32
+#define BENCH_NULL_FILE "NUL"
+#else
+#define BENCH_NULL_FILE "/dev/null"
+#endif
+#define BENCH_OBJ_FILE "geometryBench.obj" // written once to learn the size of the OBJ output
+
+///=========================================================================================///
+///                                    Allocation Counting
+///=========================================================================================///
+
+static std::atomic<size_t> allocationCount(0);
+static std::atomic<size_t> allocatedBytes(0);
+
+static void *countedAllocate(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size)
+{
+    void *p = countedAllocate(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAllocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+///=========================================================================================///
+///                                        Measurement
+///=========================================================================================///
+
+struct BenchResult
+{
+    size_t calls;
+    double seconds;     // per call
+    double allocations; // per call
+    double bytes;       // allocated per call
+};
+
+struct BenchOptions
+{
+    size_t minSamples, maxSamples;
+    std::string stage; // only stages whose name contains this
+    bool csv;
+};
+
+// A single call that takes BENCH_MIN_SECONDS is reported as it is; faster calls count as warm-up and
+// the stage repeats until BENCH_MIN_SECONDS have passed.
+static BenchResult measure(const std::function<void()> &call)
+{
+    typedef std::chrono::steady_clock Clock;
+    BenchResult result = {0, 0.0, 0.0, 0.0};
+
+    size_t allocationsBefore = allocationCount, bytesBefore = allocatedBytes;
+    Clock::time_point start = Clock::now();
+    call();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    if (elapsed < BENCH_MIN_SECONDS)
+    {
+        allocationsBefore = allocationCount;
+        bytesBefore = allocatedBytes;
+        start = Clock::now();
+        do
+        {
+            call();
+            ++result.calls;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < BENCH_MIN_SECONDS);
+    }
+    else
+    {
+        result.calls = 1;
+    }
+
+    result.seconds = elapsed / result.calls;
+    result.allocations = (double)(allocationCount - allocationsBefore) / result.calls;
+    result.bytes = (double)(allocatedBytes - bytesBefore) / result.calls;
+    return result;
+}
+
+static void report(const BenchOptions &options, const char *stage, size_t samples, double outputBytes, const BenchResult &result)
+{
+    double nsPerSample = 1e9 * result.seconds / samples;
+    double mbPerSecond = outputBytes / result.seconds / 1e6;
+    if (options.csv)
+    {
+        printf("%s,%zu,%zu,%.9f,%.3f,%.1f,%.1f,%.0f\n", stage, samples, result.calls, result.seconds, nsPerSample, mbPerSecond,
+               result.allocations, result.bytes);
+    }
+    else
+    {
+        printf("%-16s %9zu %7zu %11.3f %10.2f %9.1f %12.1f %14.1f\n", stage, samples, result.calls, 1e3 * result.seconds, nsPerSample,
+               mbPerSecond, result.allocations, result.bytes / 1024.0);
+    }
+    fflush(stdout);
+}
+
+static bool selected(const BenchOptions &options, const char *stage)
+{
+    return options.stage.empty() || std::string(stage).find(options.stage) != std::string::npos;
+}
+
+template <typename T, typename A>
+static double vectorBytes(const std::vector<T, A> &v)
+{
+    return (double)v.size() * sizeof(T);
+}
+
+///=========================================================================================///
+///                                          Stages
+///=========================================================================================///
+
+// The first preset of the UI
+static HarmonographParams benchParams()
+{
+    HarmonographParams params = {0.5f,
+                                 {3.001f, 2.0f, 3.0f},
+                                 {2.0f, 3.0f, 2.0f},
+                                 {0.004f, 0.0065f, 0.008f},
+                                 {0.019f, 0.012f, 0.005f},
+                                 {0.0f, 0.0f, (float)M_PI / 2},
+                                 {3 * (float)M_PI / 2, (float)M_PI / 4, 2 * (float)M_PI}};
+    return params;
+}
+
+static void runStages(const BenchOptions &options, size_t samples)
+{
+    const HarmonographParams params = benchParams();
+    const float step = HARMONOGRAPH_STEP;
+    const float animationTime = samples * step;
+    samples = harmonographSampleCount(animationTime, step);
+
+    if (selected(options, "evaluate"))
+    {
+        std::vector<glm::vec3> positions(samples), velocities(samples), accelerations(samples);
+        BenchResult result = measure([&]() { evaluateHarmonograph(params, step, samples, positions.data(), velocities.data(), accelerations.data()); });
+        report(options, "evaluate", samples, 3 * vectorBytes(positions), result);
+    }
+
+    ExportMesh exportMesh;
+    {
+        ExtrudedMesh mesh;
+        buildExtrudedMesh(params, animationTime, step, mesh);
+
+        if (selected(options, "ribbon normals"))
+        {
+            BenchResult result = measure([&]() { calculateTriangleStripNormals(mesh.ribbon.data(), nullptr, mesh.ribbon.size(), mesh.ribbonNormals.data()); });
+            report(options, "ribbon normals", samples, vectorBytes(mesh.ribbonNormals), result);
+        }
+
+        if (selected(options, "extrude"))
+        {
+            BenchResult result = measure([&]() { extrudeSurface(mesh.ribbon.data(), mesh.ribbonNormals.data(), mesh.ribbon.size(), EXTRUSION_DISTANCE, mesh); });
+            report(options, "extrude", samples, vectorBytes(mesh.vertices) + vectorBytes(mesh.indices), result);
+        }
+
+        // single-threaded, as the public function is; buildExtrudedMesh splits large strips over threads
+        if (selected(options, "strip normals"))
+        {
+            BenchResult result = measure([&]() {
+                for (int s = 0; s < SURFACE_COUNT; ++s)
+                {
+                    size_t start = mesh.surfaceStart[s];
+                    calculateTriangleStripNormals(mesh.vertices.data(), mesh.indices.data() + start, mesh.surfaceSize(s), mesh.normals.data() + start, s == SURFACE_TOP);
+                }
+            });
+            report(options, "strip normals", samples, vectorBytes(mesh.normals), result);
+        }
+
+        if (selected(options, "build mesh"))
+        {
+            BenchResult result = measure([&]() { buildExtrudedMesh(params, animationTime, step, mesh); });
+            double bytes = vectorBytes(mesh.curve) + vectorBytes(mesh.ribbon) + vectorBytes(mesh.ribbonNormals) + vectorBytes(mesh.vertices) +
+                           vectorBytes(mesh.indices) + vectorBytes(mesh.normals);
+            report(options, "build mesh", samples, bytes, result);
+        }
+
+        // Without welding: the OBJ stage measures formatting, and welding needs far more memory at 1e7 samples
+        if (selected(options, "export mesh") || selected(options, "obj"))
+        {
+            BenchResult result = measure([&]() { buildExportMesh(mesh, exportMesh, false); });
+            double bytes = vectorBytes(exportMesh.positions) + vectorBytes(exportMesh.normals) + vectorBytes(exportMesh.vertexPositions) +
+                           vectorBytes(exportMesh.vertexNormals) + vectorBytes(exportMesh.triangles);
+            if (selected(options, "export mesh"))
+            {
+                report(options, "export mesh", samples, bytes, result);
+            }
+        }
+    }
+
+    if (selected(options, "obj"))
+    {
+        double bytes = 0.0;
+        if (exportToObj(exportMesh, BENCH_OBJ_FILE))
+        {
+            FILE *file = fopen(BENCH_OBJ_FILE, "rb");
+            if (file)
+            {
+                fseek(file, 0, SEEK_END);
+                bytes = (double)ftell(file);
+                fclose(file);
+            }
+            remove(BENCH_OBJ_FILE);
+        }
+        BenchResult result = measure([&]() { exportToObj(exportMesh, BENCH_NULL_FILE); });
+        report(options, "obj", samples, bytes, result);
+    }
+}
+
+///=========================================================================================///
+///                                      Main Function
+///=========================================================================================///
+
+int main(int argc, char **argv)
+{
+    BenchOptions options = {BENCH_MIN_SAMPLES, BENCH_MAX_SAMPLES, "", false};
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--csv")
+        {
+            options.csv = true;
+        }
+        else if (arg == "--min" && i + 1 < argc)
+        {
+            options.minSamples = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--max" && i + 1 < argc)
+        {
+            options.maxSamples = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--stage" && i + 1 < argc)
+        {
+            options.stage = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--min N] [--max N] [--stage NAME] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (options.csv)
+    {
+        printf("stage,samples,calls,seconds_per_call,ns_per_sample,mb_per_s,allocations_per_call,bytes_allocated_per_call\n");
+    }
+    else
+    {
+        printf("%u threads\n", parallelThreadCount());
+        printf("%-16s %9s %7s %11s %10s %9s %12s %14s\n", "stage", "samples", "calls", "ms/call", "ns/sample", "MB/s", "allocs/call", "KB alloc/call");
+    }
+
+    for (size_t samples = options.minSamples; samples <= options.maxSamples; samples *= 10)
+    {
+        runStages(options, samples);
+    }
+    return 0;
+}
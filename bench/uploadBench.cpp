@@ -0,0 +1,558 @@
+// Compares the ways the curve and the extruded mesh can reach the GPU each frame.
+//
+// usage: HarmonographUploadBench [--min N] [--max N] [--frames N] [--csv]
+//
+// Runs in a hidden GLFW window and draws into an offscreen framebuffer, so it needs a display but
+// shows nothing. On a machine without a GPU, run it under Xvfb with Mesa's llvmpipe:
+//     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./HarmonographUploadBench
+//
+// For every workload, strategy and sample count it uploads the same vertices and draws them each frame,
+// and reports the CPU time spent submitting the upload and the draws, the GPU time of the frame from
+// GL_TIME_ELAPSED queries and the frames per second including everything the GPU has to finish.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "geometry.h"
+#include "shaderSource.h"
+
+#define BENCH_MIN_SAMPLES 1000
+#define BENCH_MAX_SAMPLES 1000000
+#define BENCH_FRAMES 100        // measured frames per case at most
+#define BENCH_WARMUP_FRAMES 3   // frames drawn before measuring
+#define BENCH_CASE_SECONDS 2.0  // a case stops early after this long, once it has BENCH_MIN_FRAMES
+#define BENCH_MIN_FRAMES 5
+#define BENCH_QUERY_LATENCY 4   // frames between issuing a timer query and reading it
+#define BENCH_RING_REGIONS 3    // regions of the persistently mapped buffer
+#define BENCH_WIDTH 1280        // offscreen framebuffer
+#define BENCH_HEIGHT 720
+
+///=========================================================================================///
+///                                        Strategies
+///=========================================================================================///
+
+enum UploadStrategy
+{
+    UPLOAD_BUFFER_DATA,    // glBufferData with the vertices every frame, re-creating the storage
+    UPLOAD_SUB_DATA,       // glBufferSubData into storage allocated once
+    UPLOAD_ORPHAN,         // glBufferData(NULL) to orphan the old storage, then glBufferSubData
+    UPLOAD_MAP_INVALIDATE, // glMapBufferRange with GL_MAP_INVALIDATE_BUFFER_BIT and memcpy, as the app does
+    UPLOAD_PERSISTENT,     // a ring of regions in one persistently mapped buffer, fenced (GL 4.4)
+    UPLOAD_VERTEX_SHADER,  // nothing uploaded: the vertex shader evaluates the curve (curve only)
+    UPLOAD_STRATEGY_COUNT
+};
+
+static const char *strategyNames[UPLOAD_STRATEGY_COUNT] = {"bufferData", "subData", "orphan", "mapInvalidate", "persistent", "vertexShader"};
+
+enum Workload
+{
+    WORKLOAD_CURVE, // line strip of the curve samples
+    WORKLOAD_MESH,  // interleaved position and normal of the six strips of the extruded mesh
+    WORKLOAD_COUNT
+};
+
+static const char *workloadNames[WORKLOAD_COUNT] = {"curve", "mesh"};
+
+// Evaluates the curve at gl_VertexID * step exactly as evaluateSample does, then continues as the
+// default vertex shader; the terms are ordered x1 x2 y1 y2 z1 z2.
+static const char *evaluateVertexShaderSource =
+    "#version 330\n"
+    "uniform mat4 model;\n"
+    "uniform mat4 view;\n"
+    "uniform mat4 projection;\n"
+    "uniform vec3 lightColor;\n"
+    "uniform vec3 meshColor1;\n"
+    "uniform vec3 meshColor2;\n"
+    "uniform float amplitude;\n"
+    "uniform float frequency[6];\n"
+    "uniform float phase[6];\n"
+    "uniform float damping[6];\n"
+    "uniform float step;\n"
+    "out vec3 lcolor;\n"
+    "out vec3 mcolor1;\n"
+    "out vec3 mcolor2;\n"
+    "out vec3 facenormal;\n"
+    "out vec3 FragPos;\n"
+    "void main()\n"
+    "{\n"
+    "   float t = float(gl_VertexID) * step;\n"
+    "   float pos[3] = float[3](0.0, 0.0, 0.0);\n"
+    "   for (int k = 0; k < 6; ++k)\n"
+    "       pos[k / 2] += amplitude * exp(-damping[k] * t) * sin(t * frequency[k] + phase[k]);\n"
+    "   vec3 aPos = vec3(pos[0], pos[1], pos[2]);\n"
+    "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+    "   lcolor = lightColor;\n"
+    "   mcolor1 = meshColor1;\n"
+    "   mcolor2 = meshColor2;\n"
+    "   FragPos = vec3(model * vec4(aPos, 1.0));\n"
+    "   facenormal = vec3(0.0);\n"
+    "}\n";
+
+///=========================================================================================///
+///                                         GL Setup
+///=========================================================================================///
+
+static unsigned int compileShader(GLenum type, const char *source)
+{
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[512];
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        fprintf(stderr, "Error: Shader compilation failed\n%s\n", infoLog);
+    }
+    return shader;
+}
+
+static unsigned int linkProgram(const char *vertexSource, const char *fragmentSource)
+{
+    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        fprintf(stderr, "Error: Shader program linking failed\n%s\n", infoLog);
+    }
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    return program;
+}
+
+// The uniforms of the default shaders, with the camera the app starts with
+static void setCommonUniforms(unsigned int program)
+{
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)BENCH_WIDTH / BENCH_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.0f));
+    glm::mat4 model(1.0f);
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniformMatrix4fv(glGetUniformLocation(program, "view"), 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniform3f(glGetUniformLocation(program, "lightColor"), 1.0f, 1.0f, 1.0f);
+    glUniform3f(glGetUniformLocation(program, "meshColor1"), 0.8f, 0.3f, 0.5f);
+    glUniform3f(glGetUniformLocation(program, "meshColor2"), 0.2f, 0.5f, 0.9f);
+    glUniform3f(glGetUniformLocation(program, "viewPos"), 0.0f, 0.0f, 3.0f);
+}
+
+static void setCurveUniforms(unsigned int program, const HarmonographParams &params, float step)
+{
+    const float w[6] = {params.freq1[0], params.freq1[1], params.freq1[2], params.freq2[0], params.freq2[1], params.freq2[2]};
+    const float p[6] = {params.phase1[0], params.phase1[1], params.phase1[2], params.phase2[0], params.phase2[1], params.phase1[2]};
+    const float d[6] = {params.damp1[0], params.damp1[1], params.damp1[2], params.damp2[0], params.damp2[1], params.damp2[2]};
+    glUseProgram(program);
+    glUniform1f(glGetUniformLocation(program, "amplitude"), params.amplitude);
+    glUniform1fv(glGetUniformLocation(program, "frequency"), 6, w);
+    glUniform1fv(glGetUniformLocation(program, "phase"), 6, p);
+    glUniform1fv(glGetUniformLocation(program, "damping"), 6, d);
+    glUniform1f(glGetUniformLocation(program, "step"), step);
+}
+
+// Color and depth renderbuffers, so nothing depends on the hidden window's own framebuffer
+static unsigned int createFramebuffer(unsigned int renderbuffers[2])
+{
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, BENCH_WIDTH, BENCH_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, BENCH_WIDTH, BENCH_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Error: Offscreen framebuffer is incomplete\n");
+    }
+    glViewport(0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+    return framebuffer;
+}
+
+///=========================================================================================///
+///                                        Measurement
+///=========================================================================================///
+
+struct BenchOptions
+{
+    size_t minSamples, maxSamples;
+    int frames;
+    bool csv;
+};
+
+// The vertices of one workload and the draws that show them
+struct WorkloadData
+{
+    std::vector<glm::vec3> vertices; // positions, or interleaved position and normal
+    size_t vertexCount;
+    size_t surfaceStart[SURFACE_COUNT + 1]; // mesh strips
+};
+
+struct CaseResult
+{
+    int frames;
+    double cpuSeconds; // submitting upload and draws, per frame
+    double gpuSeconds; // per frame
+    double fps;
+};
+
+static void draw(Workload workload, const WorkloadData &data, size_t firstVertex)
+{
+    if (workload == WORKLOAD_CURVE)
+    {
+        glDrawArrays(GL_LINE_STRIP, firstVertex, data.vertexCount);
+        return;
+    }
+    for (int s = 0; s < SURFACE_COUNT; ++s)
+    {
+        glDrawArrays(GL_TRIANGLE_STRIP, firstVertex + data.surfaceStart[s], data.surfaceStart[s + 1] - data.surfaceStart[s]);
+    }
+}
+
+static void setVertexLayout(Workload workload)
+{
+    size_t stride = workload == WORKLOAD_CURVE ? sizeof(glm::vec3) : 2 * sizeof(glm::vec3);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+    glEnableVertexAttribArray(0);
+    if (workload == WORKLOAD_MESH)
+    {
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)sizeof(glm::vec3));
+        glEnableVertexAttribArray(1);
+    }
+}
+
+static CaseResult runCase(const BenchOptions &options, Workload workload, UploadStrategy strategy, const WorkloadData &data)
+{
+    typedef std::chrono::steady_clock Clock;
+    const size_t bytes = data.vertices.size() * sizeof(glm::vec3);
+
+    unsigned int vao, vbo;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    char *ring = nullptr;
+    GLsync fences[BENCH_RING_REGIONS] = {};
+    if (strategy == UPLOAD_PERSISTENT)
+    {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, BENCH_RING_REGIONS * bytes, NULL, flags);
+        ring = (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, BENCH_RING_REGIONS * bytes, flags);
+    }
+    else if (strategy == UPLOAD_SUB_DATA || strategy == UPLOAD_MAP_INVALIDATE)
+    {
+        glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+    }
+    if (strategy != UPLOAD_VERTEX_SHADER)
+    {
+        setVertexLayout(workload);
+    }
+
+    unsigned int queries[BENCH_QUERY_LATENCY];
+    glGenQueries(BENCH_QUERY_LATENCY, queries);
+
+    CaseResult result = {0, 0.0, 0.0, 0.0};
+    const int totalFrames = BENCH_WARMUP_FRAMES + options.frames;
+    Clock::time_point measureStart = Clock::now();
+    int frame = 0;
+    for (; frame < totalFrames; ++frame)
+    {
+        bool measured = frame >= BENCH_WARMUP_FRAMES;
+        if (frame == BENCH_WARMUP_FRAMES)
+        {
+            measureStart = Clock::now();
+        }
+        else if (measured && result.frames >= BENCH_MIN_FRAMES &&
+                 std::chrono::duration<double>(Clock::now() - measureStart).count() > BENCH_CASE_SECONDS)
+        {
+            break;
+        }
+
+        // the query of BENCH_QUERY_LATENCY frames ago is most likely done by now
+        unsigned int query = queries[frame % BENCH_QUERY_LATENCY];
+        if (frame >= BENCH_QUERY_LATENCY)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+            if (frame - BENCH_QUERY_LATENCY >= BENCH_WARMUP_FRAMES)
+            {
+                result.gpuSeconds += elapsed * 1e-9;
+            }
+        }
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        Clock::time_point submitStart = Clock::now();
+
+        size_t firstVertex = 0;
+        switch (strategy)
+        {
+        case UPLOAD_BUFFER_DATA:
+            glBufferData(GL_ARRAY_BUFFER, bytes, data.vertices.data(), GL_STREAM_DRAW);
+            break;
+        case UPLOAD_SUB_DATA:
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.vertices.data());
+            break;
+        case UPLOAD_ORPHAN:
+            glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data.vertices.data());
+            break;
+        case UPLOAD_MAP_INVALIDATE:
+        {
+            void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (mapped)
+            {
+                memcpy(mapped, data.vertices.data(), bytes);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            break;
+        }
+        case UPLOAD_PERSISTENT:
+        {
+            // wait until the GPU is done with the draws that last read this region
+            int region = frame % BENCH_RING_REGIONS;
+            if (fences[region])
+            {
+                while (glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                {
+                }
+                glDeleteSync(fences[region]);
+                fences[region] = 0;
+            }
+            if (ring)
+            {
+                memcpy(ring + region * bytes, data.vertices.data(), bytes);
+            }
+            firstVertex = region * data.vertexCount;
+            break;
+        }
+        default:
+            break;
+        }
+
+        draw(workload, data, firstVertex);
+        if (strategy == UPLOAD_PERSISTENT)
+        {
+            fences[frame % BENCH_RING_REGIONS] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        double submit = std::chrono::duration<double>(Clock::now() - submitStart).count();
+        // flushing inside the query makes software renderers such as llvmpipe, which rasterize on a
+        // flush, count the rasterization as GPU time
+        glFlush();
+        glEndQuery(GL_TIME_ELAPSED);
+        if (measured)
+        {
+            result.cpuSeconds += submit;
+            ++result.frames;
+        }
+    }
+
+    // everything submitted counts towards the frame rate
+    glFinish();
+    double wall = std::chrono::duration<double>(Clock::now() - measureStart).count();
+    for (int f = std::max(frame - BENCH_QUERY_LATENCY, BENCH_WARMUP_FRAMES); f < frame; ++f)
+    {
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[f % BENCH_QUERY_LATENCY], GL_QUERY_RESULT, &elapsed);
+        result.gpuSeconds += elapsed * 1e-9;
+    }
+
+    if (result.frames > 0)
+    {
+        result.cpuSeconds /= result.frames;
+        result.gpuSeconds /= result.frames;
+        result.fps = result.frames / wall;
+    }
+
+    for (int r = 0; r < BENCH_RING_REGIONS; ++r)
+    {
+        if (fences[r])
+        {
+            glDeleteSync(fences[r]);
+        }
+    }
+    if (ring)
+    {
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glDeleteQueries(BENCH_QUERY_LATENCY, queries);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    return result;
+}
+
+static void report(const BenchOptions &options, Workload workload, UploadStrategy strategy, size_t samples, const WorkloadData &data, const CaseResult &result)
+{
+    double megabytes = strategy == UPLOAD_VERTEX_SHADER ? 0.0 : data.vertices.size() * sizeof(glm::vec3) / 1e6;
+    if (options.csv)
+    {
+        printf("%s,%s,%zu,%zu,%.3f,%d,%.6f,%.6f,%.2f\n", workloadNames[workload], strategyNames[strategy], samples, data.vertexCount, megabytes,
+               result.frames, 1e3 * result.cpuSeconds, 1e3 * result.gpuSeconds, result.fps);
+    }
+    else
+    {
+        printf("%-6s %-14s %9zu %10zu %9.2f %7d %10.3f %10.3f %9.1f\n", workloadNames[workload], strategyNames[strategy], samples, data.vertexCount,
+               megabytes, result.frames, 1e3 * result.cpuSeconds, 1e3 * result.gpuSeconds, result.fps);
+    }
+    fflush(stdout);
+}
+
+///=========================================================================================///
+///                                      Main Function
+///=========================================================================================///
+
+// The first preset of the UI
+static HarmonographParams benchParams()
+{
+    HarmonographParams params = {0.5f,
+                                 {3.001f, 2.0f, 3.0f},
+                                 {2.0f, 3.0f, 2.0f},
+                                 {0.004f, 0.0065f, 0.008f},
+                                 {0.019f, 0.012f, 0.005f},
+                                 {0.0f, 0.0f, (float)M_PI / 2},
+                                 {3 * (float)M_PI / 2, (float)M_PI / 4, 2 * (float)M_PI}};
+    return params;
+}
+
+int main(int argc, char **argv)
+{
+    BenchOptions options = {BENCH_MIN_SAMPLES, BENCH_MAX_SAMPLES, BENCH_FRAMES, false};
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--csv")
+        {
+            options.csv = true;
+        }
+        else if (arg == "--min" && i + 1 < argc)
+        {
+            options.minSamples = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--max" && i + 1 < argc)
+        {
+            options.maxSamples = strtoull(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--frames" && i + 1 < argc)
+        {
+            options.frames = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--min N] [--max N] [--frames N] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    if (!glfwInit())
+    {
+        fprintf(stderr, "Error: Unable to initialize GLFW\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "HarmonographUploadBench", NULL, NULL);
+    if (!window)
+    {
+        fprintf(stderr, "Error: Unable to create an OpenGL 3.3 context\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        fprintf(stderr, "Error: Failed to initialize GLAD\n");
+        return 1;
+    }
+
+    unsigned int renderbuffers[2];
+    unsigned int framebuffer = createFramebuffer(renderbuffers);
+    glEnable(GL_DEPTH_TEST);
+    unsigned int defaultProgram = linkProgram(vertexShaderSource, fragmentShaderSource);
+    unsigned int evaluateProgram = linkProgram(evaluateVertexShaderSource, fragmentShaderSource);
+    setCommonUniforms(defaultProgram);
+    setCommonUniforms(evaluateProgram);
+    const HarmonographParams params = benchParams();
+    setCurveUniforms(evaluateProgram, params, HARMONOGRAPH_STEP);
+
+    // glBufferStorage is core in 4.4; drivers asked for 3.3 core usually give their newest version
+    bool persistent = GLAD_GL_VERSION_4_4 != 0;
+
+    if (options.csv)
+    {
+        printf("workload,strategy,samples,vertices,mb_per_frame,frames,cpu_ms,gpu_ms,fps\n");
+    }
+    else
+    {
+        printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+        printf("%-6s %-14s %9s %10s %9s %7s %10s %10s %9s\n", "load", "strategy", "samples", "vertices", "MB/frame", "frames", "cpu ms", "gpu ms", "fps");
+    }
+
+    for (size_t samples = options.minSamples; samples <= options.maxSamples; samples *= 10)
+    {
+        const float animationTime = samples * HARMONOGRAPH_STEP;
+        ExtrudedMesh mesh;
+        buildExtrudedMesh(params, animationTime, HARMONOGRAPH_STEP, mesh);
+
+        WorkloadData workloads[WORKLOAD_COUNT];
+        workloads[WORKLOAD_CURVE].vertices.assign(mesh.curve.begin(), mesh.curve.end());
+        workloads[WORKLOAD_CURVE].vertexCount = mesh.curve.size();
+        workloads[WORKLOAD_MESH].vertices.resize(2 * mesh.indices.size());
+        interleaveExtrudedMesh(mesh, workloads[WORKLOAD_MESH].vertices.data());
+        workloads[WORKLOAD_MESH].vertexCount = mesh.indices.size();
+        for (int s = 0; s <= SURFACE_COUNT; ++s)
+        {
+            workloads[WORKLOAD_MESH].surfaceStart[s] = mesh.surfaceStart[s];
+        }
+
+        for (int w = 0; w < WORKLOAD_COUNT; ++w)
+        {
+            for (int s = 0; s < UPLOAD_STRATEGY_COUNT; ++s)
+            {
+                // the vertex shader can only evaluate the curve; the mesh needs its neighbours
+                if ((s == UPLOAD_PERSISTENT && !persistent) || (s == UPLOAD_VERTEX_SHADER && w != WORKLOAD_CURVE))
+                {
+                    continue;
+                }
+                glUseProgram(s == UPLOAD_VERTEX_SHADER ? evaluateProgram : defaultProgram);
+                CaseResult result = runCase(options, (Workload)w, (UploadStrategy)s, workloads[w]);
+                report(options, (Workload)w, (UploadStrategy)s, mesh.curve.size(), workloads[w], result);
+            }
+        }
+    }
+
+    glDeleteProgram(defaultProgram);
+    glDeleteProgram(evaluateProgram);
+    glDeleteRenderbuffers(2, renderbuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,280 @@
+#include "allocationTracker.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "bufferedWriter.h"
+
+#define ALLOCATION_HEADER 16   // bytes in front of each block holding its size; keeps malloc's alignment
+#define ALLOCATION_LOG_LINE 512 // longest line of the log
+
+///=========================================================================================///
+///                                    Allocation Tracker
+///=========================================================================================///
+
+AllocationTracker allocationTracker;
+
+static thread_local bool renderThread = false;
+static std::unique_ptr<BufferedWriter> allocationLog;
+
+uint64_t AllocationFrame::totalAllocations() const
+{
+    uint64_t total = 0;
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+    {
+        total += allocations[s];
+    }
+    return total;
+}
+
+uint64_t AllocationFrame::totalBytes() const
+{
+    uint64_t total = 0;
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+    {
+        total += bytes[s];
+    }
+    return total;
+}
+
+bool AllocationTracker::isEnabled() const
+{
+#ifdef TRACK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool AllocationTracker::openLog(const std::string &filename)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+
+    allocationLog.reset(new BufferedWriter());
+    if (!allocationLog->open(filename))
+    {
+        std::cerr << "Error: Could not open allocation log " << filename << std::endl;
+        allocationLog.reset();
+        return false;
+    }
+
+    char *out = allocationLog->reserve(ALLOCATION_LOG_LINE);
+    out += sprintf(out, "frame,allocations,bytes,frees,worker_allocations,worker_bytes,peak_heap_bytes,rss_bytes");
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+    {
+        out += sprintf(out, ",%s_allocations", profileStageNames[s]);
+    }
+    *out++ = '\n';
+    allocationLog->commit(out);
+    return true;
+}
+
+// Resident set of the process now; 0 where unknown
+static uint64_t currentRss()
+{
+#ifdef __linux__
+    static int statm = open("/proc/self/statm", O_RDONLY);
+    char text[64];
+    ssize_t size = statm >= 0 ? pread(statm, text, sizeof(text) - 1, 0) : -1;
+    if (size <= 0)
+    {
+        return 0;
+    }
+    text[size] = '\0';
+    unsigned long long pages = 0, resident = 0;
+    if (sscanf(text, "%llu %llu", &pages, &resident) != 2)
+    {
+        return 0;
+    }
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+// The kernel updates ru_maxrss lazily, so it can be a little below the current resident set
+uint64_t AllocationTracker::peakRss() const
+{
+    uint64_t peak = currentRss();
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef __APPLE__
+        peak = std::max(peak, (uint64_t)usage.ru_maxrss); // bytes
+#else
+        peak = std::max(peak, (uint64_t)usage.ru_maxrss * 1024); // kilobytes
+#endif
+    }
+#endif
+    return peak;
+}
+
+void AllocationTracker::beginFrame()
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    renderThread = true;
+    current = AllocationFrame();
+    current.number = completed;
+    workerAllocations = 0;
+    workerBytes = 0;
+    framePeakHeap = liveHeap.load(std::memory_order_relaxed);
+}
+
+void AllocationTracker::endFrame()
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+
+    // Snapshot first, so the bookkeeping below is not counted
+    AllocationFrame &frame = frames[completed % PROFILER_HISTORY];
+    frame = current;
+    frame.workerAllocations = workerAllocations.load(std::memory_order_relaxed);
+    frame.workerBytes = workerBytes.load(std::memory_order_relaxed);
+    frame.peakHeap = framePeakHeap.load(std::memory_order_relaxed);
+    frame.rss = currentRss();
+    ++completed;
+
+    peakAllocations = std::max(peakAllocations, frame.totalAllocations());
+    peakBytes = std::max(peakBytes, frame.totalBytes());
+    heapHighWater = std::max(heapHighWater, frame.peakHeap);
+
+    if (allocationLog)
+    {
+        char *out = allocationLog->reserve(ALLOCATION_LOG_LINE);
+        out += sprintf(out, "%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu", (unsigned long long)frame.number,
+                       (unsigned long long)frame.totalAllocations(), (unsigned long long)frame.totalBytes(), (unsigned long long)frame.frees,
+                       (unsigned long long)frame.workerAllocations, (unsigned long long)frame.workerBytes, (unsigned long long)frame.peakHeap,
+                       (unsigned long long)frame.rss);
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            out += sprintf(out, ",%llu", (unsigned long long)frame.allocations[s]);
+        }
+        *out++ = '\n';
+        allocationLog->commit(out);
+    }
+}
+
+void AllocationTracker::allocated(size_t size)
+{
+    uint64_t live = liveHeap.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t peak = framePeakHeap.load(std::memory_order_relaxed);
+    while (live > peak && !framePeakHeap.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+
+    if (renderThread)
+    {
+        ProfileStage stage = frameProfiler.profilesThisThread() ? frameProfiler.activeStage() : PROFILE_OTHER;
+        ++current.allocations[stage];
+        current.bytes[stage] += size;
+    }
+    else
+    {
+        workerAllocations.fetch_add(1, std::memory_order_relaxed);
+        workerBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+void AllocationTracker::freed(size_t size)
+{
+    liveHeap.fetch_sub(size, std::memory_order_relaxed);
+    if (renderThread)
+    {
+        ++current.frees;
+    }
+}
+
+///=========================================================================================///
+///                                          Hooks
+///=========================================================================================///
+
+#ifdef TRACK_ALLOCATIONS
+
+static void *trackedAllocate(size_t size)
+{
+    char *block = (char *)malloc(size + ALLOCATION_HEADER);
+    if (!block)
+    {
+        return nullptr;
+    }
+    *(size_t *)block = size;
+    allocationTracker.allocated(size);
+    return block + ALLOCATION_HEADER;
+}
+
+static void trackedFree(void *p)
+{
+    if (p)
+    {
+        char *block = (char *)p - ALLOCATION_HEADER;
+        allocationTracker.freed(*(size_t *)block);
+        free(block);
+    }
+}
+
+void *operator new(size_t size)
+{
+    void *p = trackedAllocate(size);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return trackedAllocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return trackedAllocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    trackedFree(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    trackedFree(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    trackedFree(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    trackedFree(p);
+}
+
+#endif
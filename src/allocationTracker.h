@@ -0,0 +1,75 @@
+#ifndef ALLOCATIONTRACKER_H
+#define ALLOCATIONTRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "profiler.h"
+
+#define ALLOCATION_LOG_FILE "harmonograph_allocations.csv" // one line per frame in allocation-tracking builds
+
+/******************************************************************************/
+/*****************************   Allocation Tracker ***************************/
+/******************************************************************************/
+
+// Heap traffic of one frame. Allocations of the render thread count for the profiler stage that was
+// active (PROFILE_OTHER while the profiler is off); those of every other thread are summed apart.
+struct AllocationFrame
+{
+    uint64_t number;
+    uint64_t allocations[PROFILE_STAGE_COUNT];
+    uint64_t bytes[PROFILE_STAGE_COUNT];
+    uint64_t frees;                          // on the render thread
+    uint64_t workerAllocations, workerBytes; // on other threads
+    uint64_t peakHeap;                       // most live heap bytes of the process during the frame
+    uint64_t rss;                            // resident set at the end of the frame; 0 where unknown
+
+    uint64_t totalAllocations() const;
+    uint64_t totalBytes() const;
+};
+
+// Counts heap allocations through replaced global operator new and delete. The hooks are only compiled
+// in when TRACK_ALLOCATIONS is defined (cmake -DHARMONOGRAPH_TRACK_ALLOCATIONS=ON); otherwise
+// isEnabled() is false and every call does nothing.
+class AllocationTracker
+{
+public:
+    bool isEnabled() const;
+
+    // Write every completed frame to filename as CSV
+    bool openLog(const std::string &filename);
+
+    // The thread calling beginFrame is the render thread
+    void beginFrame();
+    void endFrame();
+
+    size_t frameCount() const { return completed < PROFILER_HISTORY ? (size_t)completed : PROFILER_HISTORY; }
+    // A completed frame; age 0 is the newest
+    const AllocationFrame &frame(size_t age) const { return frames[(completed - 1 - age) % PROFILER_HISTORY]; }
+
+    // Highest of any completed frame since the start
+    uint64_t peakFrameAllocations() const { return peakAllocations; }
+    uint64_t peakFrameBytes() const { return peakBytes; }
+    uint64_t peakHeap() const { return heapHighWater; }
+    // High-water resident set of the process; 0 where unknown
+    uint64_t peakRss() const;
+
+    // Used by the operator new and delete hooks; they must not allocate
+    void allocated(size_t size);
+    void freed(size_t size);
+
+private:
+    // No constructor: the hooks run before static initialization, and all-zero storage is a valid state
+    AllocationFrame current;
+    AllocationFrame frames[PROFILER_HISTORY];
+    uint64_t completed;
+    uint64_t peakAllocations, peakBytes, heapHighWater;
+    std::atomic<uint64_t> workerAllocations, workerBytes;
+    std::atomic<uint64_t> liveHeap, framePeakHeap;
+};
+
+extern AllocationTracker allocationTracker;
+
+#endif //ALLOCATIONTRACKER_H
@@ -0,0 +1,261 @@
+#include "bufferedWriter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <clocale>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#ifndef _WIN32
+#include <climits>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+///=========================================================================================///
+///                                    Number Formatting
+///=========================================================================================///
+
+static const uint64_t powersOfTen[10] = {1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull, 1000000000ull};
+
+static char *formatUInt64(char *out, uint64_t value)
+{
+    char digits[20];
+    int count = 0;
+    do
+    {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (count)
+    {
+        *out++ = digits[--count];
+    }
+    return out;
+}
+
+char *formatUInt(char *out, unsigned int value)
+{
+    return formatUInt64(out, value);
+}
+
+// Write scaled / 10^precision without trailing zeros
+static char *formatScaled(char *out, uint64_t scaled, int precision)
+{
+    uint64_t scale = powersOfTen[precision];
+    uint64_t integer = scaled / scale;
+    uint64_t fraction = scaled % scale;
+    out = formatUInt64(out, integer);
+
+    if (fraction != 0)
+    {
+        int digits = precision;
+        while (fraction % 10 == 0)
+        {
+            fraction /= 10;
+            digits--;
+        }
+
+        *out++ = '.';
+        for (int i = digits - 1; i >= 0; --i)
+        {
+            out[i] = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        out += digits;
+    }
+    return out;
+}
+
+char *formatFloat(char *out, float value, int precision)
+{
+    precision = precision < 0 ? 0 : (precision > 9 ? 9 : precision);
+
+    double magnitude = std::fabs((double)value);
+    if (!(magnitude < 1e9))
+    {
+        // infinities, NaN and huge values are rare enough for the slow path; printf writes the decimal
+        // point of the locale, so it is put back to '.'
+        char *end = out + snprintf(out, FORMAT_FLOAT_MAX, "%.*g", precision > 0 ? precision : 1, value);
+        const char *point = localeconv()->decimal_point;
+        size_t pointSize = strlen(point);
+        char *found = pointSize && (pointSize != 1 || *point != '.') ? strstr(out, point) : nullptr;
+        if (found)
+        {
+            *found = '.';
+            memmove(found + 1, found + pointSize, end - (found + pointSize));
+            end -= pointSize - 1;
+        }
+        return end;
+    }
+
+    uint64_t scaled = (uint64_t)std::llround(magnitude * powersOfTen[precision]);
+
+    // values that round to zero are written without a sign
+    if (value < 0.0f && scaled != 0)
+    {
+        *out++ = '-';
+    }
+    return formatScaled(out, scaled, precision);
+}
+
+char *formatFixed(char *out, int64_t value, int decimals)
+{
+    decimals = decimals < 0 ? 0 : (decimals > 9 ? 9 : decimals);
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    return formatScaled(out, value < 0 ? 0 - (uint64_t)value : (uint64_t)value, decimals);
+}
+
+// fwrite that carries on where a signal interrupted it
+static bool writeFully(FILE *file, const void *data, size_t size)
+{
+    const char *bytes = (const char *)data;
+    while (size)
+    {
+        size_t written = fwrite(bytes, 1, size, file);
+        bytes += written;
+        size -= written;
+        if (size)
+        {
+            if (errno != EINTR)
+            {
+                return false;
+            }
+            clearerr(file);
+        }
+    }
+    return true;
+}
+
+///=========================================================================================///
+///                                      Buffered Writer
+///=========================================================================================///
+
+BufferedWriter::BufferedWriter(size_t bufferSize)
+    : file(nullptr), buffer(bufferSize), used(0), failed(false)
+{
+}
+
+BufferedWriter::~BufferedWriter()
+{
+    close();
+}
+
+bool BufferedWriter::open(const std::string &filename)
+{
+    close();
+    file = fopen(filename.c_str(), "wb");
+    failed = false;
+    used = 0;
+    if (file)
+    {
+        // our buffer already batches the writes
+        setvbuf(file, nullptr, _IONBF, 0);
+    }
+    return file != nullptr;
+}
+
+bool BufferedWriter::close()
+{
+    if (!file)
+    {
+        return false;
+    }
+    flush();
+    if (fclose(file) != 0)
+    {
+        failed = true;
+    }
+    file = nullptr;
+    return !failed;
+}
+
+void BufferedWriter::write(const void *data, size_t size)
+{
+    if (size > buffer.size())
+    {
+        // large blocks go straight to the file
+        flush();
+        if (file && !writeFully(file, data, size))
+        {
+            failed = true;
+        }
+        return;
+    }
+    char *out = reserve(size);
+    memcpy(out, data, size);
+    commit(out + size);
+}
+
+void BufferedWriter::writeBlocks(const char *const *blocks, const size_t *sizes, size_t count)
+{
+    flush();
+    if (!file)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (!writeFully(file, blocks[i], sizes[i]))
+        {
+            failed = true;
+        }
+    }
+#else
+    // The FILE is unbuffered, so writing to its descriptor keeps the output in order
+    int fd = fileno(file);
+    std::vector<iovec> pending;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (sizes[i])
+        {
+            iovec block = {(void *)blocks[i], sizes[i]};
+            pending.push_back(block);
+        }
+    }
+
+    size_t first = 0;
+    while (first < pending.size())
+    {
+        int batch = (int)std::min(pending.size() - first, (size_t)IOV_MAX);
+        ssize_t written = writev(fd, &pending[first], batch);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written < 0)
+        {
+            failed = true;
+            return;
+        }
+
+        // skip what was written; a short write leaves the rest of a block for the next call
+        while (first < pending.size() && (size_t)written >= pending[first].iov_len)
+        {
+            written -= pending[first].iov_len;
+            first++;
+        }
+        if (written > 0)
+        {
+            pending[first].iov_base = (char *)pending[first].iov_base + written;
+            pending[first].iov_len -= written;
+        }
+    }
+#endif
+}
+
+void BufferedWriter::flush()
+{
+    if (file && used && !writeFully(file, buffer.data(), used))
+    {
+        failed = true;
+    }
+    used = 0;
+}
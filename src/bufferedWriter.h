@@ -0,0 +1,101 @@
+#ifndef BUFFEREDWRITER_H
+#define BUFFEREDWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define WRITER_BUFFER_SIZE (1 << 20)  // bytes collected before each write to the file
+#define FORMAT_FLOAT_MAX 32           // longest text formatFloat produces
+#define FORMAT_UINT_MAX 10            // longest text formatUInt produces
+#define FORMAT_FIXED_MAX 21           // longest text formatFixed produces
+
+/******************************************************************************/
+/*****************************   Number Formatting ****************************/
+/******************************************************************************/
+
+// Write value with at most precision (0-9) decimals, without trailing zeros; returns the end of the text.
+// Always writes "." as the decimal point, whatever the locale, and never uses exponents for values below 1e9.
+char *formatFloat(char *out, float value, int precision);
+
+// Write value in decimal; returns the end of the text
+char *formatUInt(char *out, unsigned int value);
+
+// Write value / 10^decimals (0-9) exactly, without trailing zeros; returns the end of the text
+char *formatFixed(char *out, int64_t value, int decimals);
+
+// Little-endian binary fields, independent of the host byte order; each returns the end of the field
+inline char *putUInt16LE(char *out, uint16_t value)
+{
+    out[0] = (char)(value & 0xff);
+    out[1] = (char)(value >> 8);
+    return out + 2;
+}
+
+inline char *putUInt32LE(char *out, uint32_t value)
+{
+    out[0] = (char)(value & 0xff);
+    out[1] = (char)((value >> 8) & 0xff);
+    out[2] = (char)((value >> 16) & 0xff);
+    out[3] = (char)(value >> 24);
+    return out + 4;
+}
+
+inline char *putFloatLE(char *out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return putUInt32LE(out, bits);
+}
+
+/******************************************************************************/
+/******************************   Buffered Writer *****************************/
+/******************************************************************************/
+
+// Collects text or binary data in a large reusable buffer and writes it to the file in big blocks
+class BufferedWriter
+{
+public:
+    explicit BufferedWriter(size_t bufferSize = WRITER_BUFFER_SIZE);
+    ~BufferedWriter();
+
+    bool open(const std::string &filename);
+    bool close();
+    bool good() const { return file && !failed; }
+
+    // Pointer to at least size free bytes; call commit with the number of bytes actually used
+    char *reserve(size_t size)
+    {
+        if (buffer.size() - used < size)
+        {
+            flush();
+            if (buffer.size() < size)
+            {
+                buffer.resize(size);
+            }
+        }
+        return buffer.data() + used;
+    }
+    void commit(char *end) { used = end - buffer.data(); }
+
+    void write(const void *data, size_t size);
+    // Write several blocks back to back with as few system calls as possible (writev where available)
+    void writeBlocks(const char *const *blocks, const size_t *sizes, size_t count);
+    void flush();
+
+    FILE *handle() const { return file; }
+
+private:
+    BufferedWriter(const BufferedWriter &);
+    BufferedWriter &operator=(const BufferedWriter &);
+
+    FILE *file;
+    std::vector<char> buffer;
+    size_t used;
+    bool failed;
+};
+
+#endif //BUFFEREDWRITER_H
@@ -0,0 +1,286 @@
+#include "curveCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "bufferedWriter.h"
+
+///=========================================================================================///
+///                                       Cache Writing
+///=========================================================================================///
+
+uint64_t hashCurveParams(const HarmonographParams &params, float step)
+{
+    // FNV-1a over the bytes of the parameters and the step
+    uint64_t h = 1469598103934665603ull;
+    const unsigned char *bytes = (const unsigned char *)&params;
+    for (size_t i = 0; i < sizeof(params); ++i)
+    {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    bytes = (const unsigned char *)&step;
+    for (size_t i = 0; i < sizeof(step); ++i)
+    {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+static inline uint64_t alignCacheOffset(uint64_t offset)
+{
+    return (offset + CURVE_CACHE_ALIGNMENT - 1) & ~(uint64_t)(CURVE_CACHE_ALIGNMENT - 1);
+}
+
+bool writeCurveCache(const std::string &filename, const HarmonographParams &params, float animationTime, float step, unsigned int flags)
+{
+    size_t count = harmonographSampleCount(animationTime, step);
+    bool derivatives = (flags & CACHE_WITH_DERIVATIVES) != 0;
+
+    std::vector<glm::vec3> positions(count), velocities(derivatives ? count : 0), accelerations(derivatives ? count : 0);
+    evaluateHarmonograph(params, step, count, positions.data(), derivatives ? velocities.data() : nullptr, derivatives ? accelerations.data() : nullptr);
+
+    size_t chunkCount = (count + CURVE_CACHE_CHUNK_SAMPLES - 1) / CURVE_CACHE_CHUNK_SAMPLES;
+    std::vector<glm::vec3> chunkBounds(2 * chunkCount);
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        size_t begin = c * CURVE_CACHE_CHUNK_SAMPLES;
+        size_t end = std::min(count, begin + CURVE_CACHE_CHUNK_SAMPLES);
+        glm::vec3 lower = positions[begin], upper = positions[begin];
+        for (size_t i = begin + 1; i < end; ++i)
+        {
+            lower = glm::min(lower, positions[i]);
+            upper = glm::max(upper, positions[i]);
+        }
+        chunkBounds[2 * c] = lower;
+        chunkBounds[2 * c + 1] = upper;
+    }
+
+    ExtrudedMesh mesh;
+    std::vector<glm::vec3> meshVertices;
+    if (flags & CACHE_WITH_MESH)
+    {
+        buildExtrudedMesh(params, animationTime, step, mesh);
+        meshVertices.resize(2 * mesh.indices.size());
+        interleaveExtrudedMesh(mesh, meshVertices.data());
+    }
+
+    // zeroed, so the padding inside the header is written deterministically
+    CurveCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CURVE_CACHE_MAGIC;
+    header.version = CURVE_CACHE_VERSION;
+    header.headerSize = sizeof(header);
+    header.flags = flags;
+    header.paramsHash = hashCurveParams(params, step);
+    header.params = params;
+    header.step = step;
+    header.animationTime = animationTime;
+    header.sampleCount = count;
+    header.chunkCount = chunkCount;
+    for (int s = 0; s <= SURFACE_COUNT; ++s)
+    {
+        header.surfaceStart[s] = mesh.surfaceStart[s];
+    }
+
+    const void *sections[CACHE_SECTION_COUNT] = {positions.data(), velocities.data(), accelerations.data(), chunkBounds.data(), meshVertices.data()};
+    header.sectionSize[CACHE_POSITIONS] = positions.size() * sizeof(glm::vec3);
+    header.sectionSize[CACHE_VELOCITIES] = velocities.size() * sizeof(glm::vec3);
+    header.sectionSize[CACHE_ACCELERATIONS] = accelerations.size() * sizeof(glm::vec3);
+    header.sectionSize[CACHE_CHUNK_BOUNDS] = chunkBounds.size() * sizeof(glm::vec3);
+    header.sectionSize[CACHE_MESH] = meshVertices.size() * sizeof(glm::vec3);
+    uint64_t offset = alignCacheOffset(sizeof(header));
+    for (int s = 0; s < CACHE_SECTION_COUNT; ++s)
+    {
+        header.sectionOffset[s] = offset;
+        offset = alignCacheOffset(offset + header.sectionSize[s]);
+    }
+
+    std::string temporary = filename + ".tmp";
+    BufferedWriter writer;
+    if (!writer.open(temporary))
+    {
+        std::cerr << "Error: Unable to open file " << temporary << " for writing\n";
+        return false;
+    }
+
+    const char padding[CURVE_CACHE_ALIGNMENT] = {};
+    writer.write(&header, sizeof(header));
+    uint64_t written = sizeof(header);
+    for (int s = 0; s < CACHE_SECTION_COUNT; ++s)
+    {
+        writer.write(padding, header.sectionOffset[s] - written);
+        writer.write(sections[s], header.sectionSize[s]);
+        written = header.sectionOffset[s] + header.sectionSize[s];
+    }
+
+    if (!writer.close())
+    {
+        std::cerr << "Error: Failed writing " << temporary << "\n";
+        remove(temporary.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file here
+    remove(filename.c_str());
+#endif
+    if (rename(temporary.c_str(), filename.c_str()) != 0)
+    {
+        std::cerr << "Error: Unable to replace " << filename << "\n";
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+///=========================================================================================///
+///                                       Cache Mapping
+///=========================================================================================///
+
+CurveCache::CurveCache() : data(nullptr), size(0)
+{
+}
+
+CurveCache::~CurveCache()
+{
+    close();
+}
+
+bool CurveCache::open(const std::string &filename)
+{
+    close();
+
+#ifdef _WIN32
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    contents.resize(length > 0 ? length : 0);
+    bool complete = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+    if (!complete || contents.empty())
+    {
+        contents.clear();
+        return false;
+    }
+    data = contents.data();
+    size = contents.size();
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size <= 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void *mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps the file alive on its own
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return false;
+    }
+    data = (const char *)mapping;
+    size = status.st_size;
+#endif
+
+    if (!validate())
+    {
+        std::cerr << "Error: " << filename << " is not a valid curve cache\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void CurveCache::close()
+{
+#ifdef _WIN32
+    contents.clear();
+#else
+    if (data)
+    {
+        munmap((void *)data, size);
+    }
+#endif
+    data = nullptr;
+    size = 0;
+}
+
+// Everything the accessors rely on, so a truncated or foreign file is never read out of bounds
+bool CurveCache::validate() const
+{
+    if (size < sizeof(CurveCacheHeader))
+    {
+        return false;
+    }
+    const CurveCacheHeader &h = header();
+    if (h.magic != CURVE_CACHE_MAGIC || h.version != CURVE_CACHE_VERSION || h.headerSize != sizeof(CurveCacheHeader) ||
+        h.paramsHash != hashCurveParams(h.params, h.step))
+    {
+        return false;
+    }
+
+    // counts that cannot fit in the file would overflow the sizes below
+    if (h.sampleCount > size / sizeof(glm::vec3) || h.chunkCount > size || h.surfaceStart[SURFACE_COUNT] > size)
+    {
+        return false;
+    }
+    uint64_t vectorBytes = h.sampleCount * sizeof(glm::vec3);
+    bool derivatives = (h.flags & CACHE_WITH_DERIVATIVES) != 0;
+    bool mesh = (h.flags & CACHE_WITH_MESH) != 0;
+    const uint64_t expectedSize[CACHE_SECTION_COUNT] = {vectorBytes, derivatives ? vectorBytes : 0, derivatives ? vectorBytes : 0,
+                                                        2 * h.chunkCount * sizeof(glm::vec3), mesh ? 2 * h.surfaceStart[SURFACE_COUNT] * sizeof(glm::vec3) : 0};
+    if (h.chunkCount != (h.sampleCount + CURVE_CACHE_CHUNK_SAMPLES - 1) / CURVE_CACHE_CHUNK_SAMPLES)
+    {
+        return false;
+    }
+    for (int s = 0; s < CACHE_SECTION_COUNT; ++s)
+    {
+        if (h.sectionSize[s] != expectedSize[s] || h.sectionOffset[s] % CURVE_CACHE_ALIGNMENT != 0 ||
+            h.sectionOffset[s] > size || h.sectionSize[s] > size - h.sectionOffset[s])
+        {
+            return false;
+        }
+    }
+    for (int s = 0; s < SURFACE_COUNT; ++s)
+    {
+        if (h.surfaceStart[s] > h.surfaceStart[s + 1])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CurveCache::matches(const HarmonographParams &params, float step, float animationTime) const
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+    const CurveCacheHeader &h = header();
+    return h.paramsHash == hashCurveParams(params, step) && memcmp(&h.params, &params, sizeof(params)) == 0 && h.step == step &&
+           harmonographSampleCount(animationTime, step) <= h.sampleCount;
+}
+
+bool CurveCache::hasMesh(size_t sampleCount) const
+{
+    return isOpen() && (header().flags & CACHE_WITH_MESH) && header().sampleCount == sampleCount;
+}
@@ -0,0 +1,112 @@
+#ifndef CURVECACHE_H
+#define CURVECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+
+#define CURVE_CACHE_MAGIC 0x43474848       // "HHGC" in the first four bytes of the file
+#define CURVE_CACHE_VERSION 1              // bump whenever the layout or the generated geometry changes
+#define CURVE_CACHE_ALIGNMENT 64           // every section starts at a multiple of this many bytes
+#define CURVE_CACHE_CHUNK_SAMPLES 4096     // curve samples covered by each bounding box
+
+/******************************************************************************/
+/*****************************   Cache File Layout ****************************/
+/******************************************************************************/
+
+// Sections of a cache file, each an array stored as it is used in memory
+enum CurveCacheSection
+{
+    CACHE_POSITIONS,     // glm::vec3 per sample
+    CACHE_VELOCITIES,    // glm::vec3 per sample (CACHE_WITH_DERIVATIVES)
+    CACHE_ACCELERATIONS, // glm::vec3 per sample (CACHE_WITH_DERIVATIVES)
+    CACHE_CHUNK_BOUNDS,  // lower and upper corner of every CURVE_CACHE_CHUNK_SAMPLES samples
+    CACHE_MESH,          // interleaved (position, normal) per strip index (CACHE_WITH_MESH)
+    CACHE_SECTION_COUNT
+};
+
+enum CurveCacheFlags
+{
+    CACHE_WITH_DERIVATIVES = 1,
+    CACHE_WITH_MESH = 2
+};
+
+// First bytes of a cache file. The file is little-endian; a big-endian host reads a wrong magic and
+// rejects it.
+struct CurveCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t flags;
+    uint64_t paramsHash; // hashCurveParams of params and step
+    HarmonographParams params;
+    float step;
+    float animationTime; // the curve covers [0, animationTime)
+    uint64_t sampleCount;
+    uint64_t chunkCount;
+    uint64_t surfaceStart[SURFACE_COUNT + 1]; // strips of the mesh, as in ExtrudedMesh
+    uint64_t sectionOffset[CACHE_SECTION_COUNT];
+    uint64_t sectionSize[CACHE_SECTION_COUNT]; // bytes; 0 for a section that is not stored
+};
+
+// Hash of everything the samples depend on; a cache with another hash belongs to another curve
+uint64_t hashCurveParams(const HarmonographParams &params, float step);
+
+// Evaluate the curve up to animationTime and write it, with what flags asks for, to filename. The file
+// is written next to the target and renamed over it, so caches that are mapped stay intact.
+bool writeCurveCache(const std::string &filename, const HarmonographParams &params, float animationTime, float step, unsigned int flags);
+
+/******************************************************************************/
+/*********************************   Curve Cache ******************************/
+/******************************************************************************/
+
+// A cache file mapped read-only into memory. Opening only checks the header; the sections are used in
+// place, so they can go straight to glBufferData and are paged in as they are read.
+class CurveCache
+{
+public:
+    CurveCache();
+    ~CurveCache();
+
+    bool open(const std::string &filename);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+
+    const CurveCacheHeader &header() const { return *(const CurveCacheHeader *)data; }
+
+    // Whether the cache holds the samples of these parameters up to animationTime
+    bool matches(const HarmonographParams &params, float step, float animationTime) const;
+    // Whether the mesh in the cache is the extrusion of exactly sampleCount samples
+    bool hasMesh(size_t sampleCount) const;
+
+    const glm::vec3 *positions() const { return (const glm::vec3 *)section(CACHE_POSITIONS); }
+    const glm::vec3 *velocities() const { return (const glm::vec3 *)section(CACHE_VELOCITIES); }
+    const glm::vec3 *accelerations() const { return (const glm::vec3 *)section(CACHE_ACCELERATIONS); }
+    const glm::vec3 *chunkBounds() const { return (const glm::vec3 *)section(CACHE_CHUNK_BOUNDS); }
+    const glm::vec3 *meshVertices() const { return (const glm::vec3 *)section(CACHE_MESH); }
+
+    size_t sampleCount() const { return header().sampleCount; }
+    size_t meshVertexCount() const { return header().surfaceStart[SURFACE_COUNT]; }
+
+private:
+    CurveCache(const CurveCache &);
+    CurveCache &operator=(const CurveCache &);
+
+    // nullptr for a section that is not stored
+    const void *section(int s) const { return header().sectionSize[s] ? data + header().sectionOffset[s] : nullptr; }
+    bool validate() const;
+
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    std::vector<char> contents; // read into memory where mmap is not available
+#endif
+};
+
+#endif //CURVECACHE_H
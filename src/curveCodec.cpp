@@ -0,0 +1,388 @@
+#include "curveCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "bufferedWriter.h"
+#include "curveCache.h"
+
+///=========================================================================================///
+///                                       Integer Coding
+///=========================================================================================///
+
+// Small magnitudes of either sign to small unsigned values: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static void putVarint(std::vector<char> &out, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static bool getVarint(const unsigned char *&in, const unsigned char *end, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && in < end; shift += 7)
+    {
+        unsigned char byte = *in++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline int bitWidth(uint32_t value)
+{
+    int width = 0;
+    while (value)
+    {
+        ++width;
+        value >>= 1;
+    }
+    return width;
+}
+
+// Append CURVE_CODEC_BLOCK values of width bits each: 4 * width bytes
+static void packBlock(const uint32_t *values, int width, std::vector<char> &out)
+{
+    uint64_t bits = 0;
+    int count = 0;
+    for (int i = 0; i < CURVE_CODEC_BLOCK; ++i)
+    {
+        bits |= (uint64_t)values[i] << count;
+        count += width;
+        while (count >= 8)
+        {
+            out.push_back((char)(bits & 0xff));
+            bits >>= 8;
+            count -= 8;
+        }
+    }
+}
+
+// Every value is one unaligned word load, a shift and a mask, with no dependency between values, so
+// the loop vectorizes. Reads up to 8 bytes past the block, which the next block or the stream
+// padding covers.
+static void unpackBlock(const unsigned char *in, int width, uint32_t *values)
+{
+    const uint64_t mask = ((uint64_t)1 << width) - 1;
+    for (int i = 0; i < CURVE_CODEC_BLOCK; ++i)
+    {
+        unsigned int bit = i * width;
+        uint64_t word;
+        memcpy(&word, in + (bit >> 3), sizeof(word));
+        values[i] = (uint32_t)((word >> (bit & 7)) & mask);
+    }
+}
+
+///=========================================================================================///
+///                                          Encoding
+///=========================================================================================///
+
+static void putUInt64(std::vector<char> &out, size_t at, uint64_t value)
+{
+    memcpy(out.data() + at, &value, sizeof(value));
+}
+
+bool encodeCurve(const glm::vec3 *samples, size_t count, float tolerance, std::vector<char> &encoded)
+{
+    if (!(tolerance > 0.0f))
+    {
+        std::cerr << "Error: The curve tolerance must be positive\n";
+        return false;
+    }
+
+    // Rounding to the nearest multiple of 2 * tolerance is off by at most tolerance
+    const double quantum = 2.0 * tolerance;
+    std::vector<int32_t> quantized(3 * count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            double q = std::round(samples[i][a] / quantum);
+            if (!(std::fabs(q) < CURVE_CODEC_MAX_QUANTIZED))
+            {
+                std::cerr << "Error: Curve coordinate " << samples[i][a] << " is too large for tolerance " << tolerance << "\n";
+                return false;
+            }
+            quantized[3 * i + a] = (int32_t)q;
+        }
+    }
+
+    size_t chunkCount = (count + CURVE_CODEC_CHUNK_SAMPLES - 1) / CURVE_CODEC_CHUNK_SAMPLES;
+    CurveCodecHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = CURVE_CODEC_MAGIC;
+    header.version = CURVE_CODEC_VERSION;
+    header.headerSize = sizeof(header);
+    header.chunkSamples = CURVE_CODEC_CHUNK_SAMPLES;
+    header.tolerance = tolerance;
+    header.sampleCount = count;
+    header.chunkCount = chunkCount;
+
+    encoded.assign((const char *)&header, (const char *)&header + sizeof(header));
+    size_t offsetTable = encoded.size();
+    encoded.resize(offsetTable + (chunkCount + 1) * sizeof(uint64_t));
+    // about a byte per sample at the default tolerance
+    encoded.reserve(encoded.size() + count + CURVE_CODEC_PADDING);
+
+    uint32_t residuals[3][CURVE_CODEC_BLOCK];
+    for (size_t c = 0; c < chunkCount; ++c)
+    {
+        putUInt64(encoded, offsetTable + c * sizeof(uint64_t), encoded.size());
+        size_t begin = c * CURVE_CODEC_CHUNK_SAMPLES;
+        size_t end = std::min(count, begin + CURVE_CODEC_CHUNK_SAMPLES);
+        const int32_t *q = quantized.data();
+
+        for (int a = 0; a < 3; ++a)
+        {
+            putVarint(encoded, zigzag(q[3 * begin + a]));
+            putVarint(encoded, zigzag(end - begin > 1 ? q[3 * (begin + 1) + a] - q[3 * begin + a] : 0));
+        }
+
+        // Second differences: the error of predicting each sample from the two before it
+        for (size_t i = begin + 2; i < end; i += CURVE_CODEC_BLOCK)
+        {
+            size_t blockSize = std::min((size_t)CURVE_CODEC_BLOCK, end - i);
+            int widths[3];
+            for (int a = 0; a < 3; ++a)
+            {
+                uint32_t any = 0;
+                for (size_t j = 0; j < CURVE_CODEC_BLOCK; ++j)
+                {
+                    size_t k = i + j;
+                    residuals[a][j] = j < blockSize ? zigzag(q[3 * k + a] - 2 * q[3 * (k - 1) + a] + q[3 * (k - 2) + a]) : 0;
+                    any |= residuals[a][j];
+                }
+                widths[a] = bitWidth(any);
+                encoded.push_back((char)widths[a]);
+            }
+            for (int a = 0; a < 3; ++a)
+            {
+                packBlock(residuals[a], widths[a], encoded);
+            }
+        }
+    }
+    putUInt64(encoded, offsetTable + chunkCount * sizeof(uint64_t), encoded.size());
+    encoded.resize(encoded.size() + CURVE_CODEC_PADDING, 0);
+    return true;
+}
+
+bool writeEncodedCurve(const std::string &filename, const HarmonographParams &params, float animationTime, float step, float tolerance)
+{
+    size_t count = harmonographSampleCount(animationTime, step);
+    std::vector<glm::vec3> samples(count);
+    evaluateHarmonograph(params, step, count, samples.data());
+
+    std::vector<char> encoded;
+    if (!encodeCurve(samples.data(), count, tolerance, encoded))
+    {
+        return false;
+    }
+    CurveCodecHeader *header = (CurveCodecHeader *)encoded.data();
+    header->paramsHash = hashCurveParams(params, step);
+    header->params = params;
+    header->step = step;
+    header->animationTime = animationTime;
+
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+    writer.write(encoded.data(), encoded.size());
+    if (!writer.close())
+    {
+        std::cerr << "Error: Failed writing " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+///=========================================================================================///
+///                                          Decoding
+///=========================================================================================///
+
+bool EncodedCurve::open(const std::string &filename)
+{
+    contents.clear();
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    contents.resize(length > 0 ? length : 0);
+    bool complete = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+
+    if (!complete || !validate())
+    {
+        std::cerr << "Error: " << filename << " is not a valid encoded curve\n";
+        contents.clear();
+        return false;
+    }
+    return true;
+}
+
+bool EncodedCurve::assign(const std::vector<char> &encoded)
+{
+    contents = encoded;
+    if (!validate())
+    {
+        contents.clear();
+        return false;
+    }
+    return true;
+}
+
+// The header and the chunk table; the chunks themselves are checked as they are decoded
+bool EncodedCurve::validate() const
+{
+    if (contents.size() < sizeof(CurveCodecHeader) + sizeof(uint64_t) + CURVE_CODEC_PADDING)
+    {
+        return false;
+    }
+    const CurveCodecHeader &h = header();
+    if (h.magic != CURVE_CODEC_MAGIC || h.version != CURVE_CODEC_VERSION || h.headerSize != sizeof(CurveCodecHeader) ||
+        h.chunkSamples == 0 || !(h.tolerance > 0.0f) || (h.paramsHash != 0 && h.paramsHash != hashCurveParams(h.params, h.step)))
+    {
+        return false;
+    }
+
+    // every CURVE_CODEC_BLOCK samples take at least their three widths, so larger counts cannot fit
+    size_t size = contents.size();
+    if (h.sampleCount > size * CURVE_CODEC_BLOCK || h.chunkCount != (h.sampleCount + h.chunkSamples - 1) / h.chunkSamples ||
+        h.chunkCount > size / sizeof(uint64_t))
+    {
+        return false;
+    }
+    size_t tableEnd = sizeof(CurveCodecHeader) + (h.chunkCount + 1) * sizeof(uint64_t);
+    if (tableEnd > size - CURVE_CODEC_PADDING)
+    {
+        return false;
+    }
+
+    uint64_t previous = tableEnd;
+    for (size_t c = 0; c <= h.chunkCount; ++c)
+    {
+        uint64_t offset;
+        memcpy(&offset, contents.data() + sizeof(CurveCodecHeader) + c * sizeof(uint64_t), sizeof(offset));
+        if (offset < previous || (c == 0 && offset != tableEnd))
+        {
+            return false;
+        }
+        previous = offset;
+    }
+    return previous == size - CURVE_CODEC_PADDING;
+}
+
+size_t EncodedCurve::chunkSize(size_t chunk) const
+{
+    size_t begin = chunkBegin(chunk);
+    return std::min(sampleCount(), begin + header().chunkSamples) - begin;
+}
+
+bool EncodedCurve::decodeChunk(size_t chunk, glm::vec3 *out) const
+{
+    if (chunk >= chunkCount())
+    {
+        return false;
+    }
+    uint64_t offsets[2];
+    memcpy(offsets, contents.data() + sizeof(CurveCodecHeader) + chunk * sizeof(uint64_t), sizeof(offsets));
+    const unsigned char *in = (const unsigned char *)contents.data() + offsets[0];
+    const unsigned char *end = (const unsigned char *)contents.data() + offsets[1];
+
+    // Wrapping arithmetic, so a corrupt chunk decodes to garbage rather than overflowing
+    uint32_t value[3], difference[3];
+    for (int a = 0; a < 3; ++a)
+    {
+        uint32_t first, second;
+        if (!getVarint(in, end, first) || !getVarint(in, end, second))
+        {
+            return false;
+        }
+        value[a] = (uint32_t)unzigzag(first);
+        difference[a] = (uint32_t)unzigzag(second);
+    }
+
+    const double quantum = 2.0 * header().tolerance;
+    size_t count = chunkSize(chunk);
+    for (size_t i = 0; i < std::min(count, (size_t)2); ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            out[i][a] = (float)((int32_t)(value[a] + i * difference[a]) * quantum);
+        }
+    }
+    for (int a = 0; a < 3 && count > 1; ++a)
+    {
+        value[a] += difference[a];
+    }
+
+    uint32_t residuals[3][CURVE_CODEC_BLOCK];
+    for (size_t i = 2; i < count; i += CURVE_CODEC_BLOCK)
+    {
+        if (end - in < 3)
+        {
+            return false;
+        }
+        int widths[3] = {in[0], in[1], in[2]};
+        in += 3;
+        for (int a = 0; a < 3; ++a)
+        {
+            if (widths[a] > 32 || end - in < 4 * widths[a])
+            {
+                return false;
+            }
+            unpackBlock(in, widths[a], residuals[a]);
+            in += 4 * widths[a];
+        }
+
+        size_t blockSize = std::min((size_t)CURVE_CODEC_BLOCK, count - i);
+        for (int a = 0; a < 3; ++a)
+        {
+            for (size_t j = 0; j < blockSize; ++j)
+            {
+                difference[a] += (uint32_t)unzigzag(residuals[a][j]);
+                value[a] += difference[a];
+                out[i + j][a] = (float)((int32_t)value[a] * quantum);
+            }
+        }
+    }
+    return in == end;
+}
+
+bool EncodedCurve::decode(glm::vec3 *out) const
+{
+    for (size_t c = 0; c < chunkCount(); ++c)
+    {
+        if (!decodeChunk(c, out + chunkBegin(c)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
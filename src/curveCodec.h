@@ -0,0 +1,85 @@
+#ifndef CURVECODEC_H
+#define CURVECODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+
+#define CURVE_CODEC_MAGIC 0x5a474848          // "HHGZ" in the first four bytes of the stream
+#define CURVE_CODEC_VERSION 1
+#define CURVE_CODEC_EXTENSION "hgz"
+#define CURVE_CODEC_CHUNK_SAMPLES 4096        // samples in each independently decodable chunk
+#define CURVE_CODEC_BLOCK 32                  // residuals packed with one bit width
+#define CURVE_CODEC_PADDING 8                 // zero bytes after the last chunk, so unpacking may read a whole word
+#define CURVE_CODEC_DEFAULT_TOLERANCE 1e-4f   // largest error of a decoded coordinate, in curve units
+#define CURVE_CODEC_MAX_QUANTIZED (1 << 28)   // quantized coordinates stay below this, so residuals fit 32 bits
+
+/******************************************************************************/
+/*****************************   Stream Layout ********************************/
+/******************************************************************************/
+
+// A stream is the header, chunkCount + 1 uint64 chunk offsets from the start of the stream, the chunks
+// and CURVE_CODEC_PADDING zero bytes. Coordinates are rounded to multiples of 2 * tolerance. Every
+// chunk starts with the first sample and the first difference of its own, as zigzag varints per axis,
+// so it decodes without the chunks before it. The second differences of the remaining samples follow
+// in blocks of CURVE_CODEC_BLOCK: three bit widths (x, y, z), then the zigzagged residuals of each
+// axis packed with its width into 4 * width bytes. Little-endian, like the curve cache.
+struct CurveCodecHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t chunkSamples;
+    uint64_t paramsHash; // hashCurveParams of params and step; 0 for samples of no particular design
+    HarmonographParams params;
+    float step;
+    float animationTime;
+    float tolerance;
+    uint64_t sampleCount;
+    uint64_t chunkCount;
+};
+
+// Encode count samples into encoded, replacing its contents. Returns false and reports on stderr when
+// a coordinate is too large for the tolerance.
+bool encodeCurve(const glm::vec3 *samples, size_t count, float tolerance, std::vector<char> &encoded);
+
+// Evaluate the curve up to animationTime, encode it with the design in the header and write it to filename
+bool writeEncodedCurve(const std::string &filename, const HarmonographParams &params, float animationTime, float step, float tolerance);
+
+/******************************************************************************/
+/*****************************   Encoded Curve ********************************/
+/******************************************************************************/
+
+// A validated stream held in memory, decoded a chunk at a time
+class EncodedCurve
+{
+public:
+    bool open(const std::string &filename);
+    bool assign(const std::vector<char> &encoded);
+    bool isOpen() const { return !contents.empty(); }
+
+    const CurveCodecHeader &header() const { return *(const CurveCodecHeader *)contents.data(); }
+    size_t sampleCount() const { return header().sampleCount; }
+    size_t chunkCount() const { return header().chunkCount; }
+    size_t chunkBegin(size_t chunk) const { return chunk * header().chunkSamples; }
+    size_t chunkSize(size_t chunk) const;
+    // Compressed bytes of the whole stream
+    size_t size() const { return contents.size(); }
+
+    // Decode the chunkSize(chunk) samples of chunk into out; false if the chunk is corrupt
+    bool decodeChunk(size_t chunk, glm::vec3 *out) const;
+    // Decode all sampleCount() samples into out
+    bool decode(glm::vec3 *out) const;
+
+private:
+    bool validate() const;
+
+    std::vector<char> contents;
+};
+
+#endif //CURVECODEC_H
@@ -0,0 +1,187 @@
+#include "exportWorker.h"
+
+#include "curveCache.h"
+#include "traceRecorder.h"
+
+ExportWorker::ExportWorker()
+    : nextId(1), succeeded(), currentKind(MESH), currentState(IDLE), moves(0), stopping(false)
+{
+}
+
+ExportWorker::~ExportWorker()
+{
+    shutdown();
+}
+
+void ExportWorker::submit(ExtrudedMesh &&mesh, const ExportSettings &settings, const std::string &filename)
+{
+    enqueue(std::unique_ptr<Job>(new Job{MESH, 0, std::move(mesh), settings, PlotSettings(), HarmonographParams(), 0.0f, filename}));
+}
+
+unsigned long ExportWorker::submitDesign(const HarmonographParams &params, float animationTime, const std::string &filename)
+{
+    return enqueue(std::unique_ptr<Job>(new Job{DESIGN, 0, ExtrudedMesh(), ExportSettings(), PlotSettings(), params, animationTime, filename}));
+}
+
+void ExportWorker::submitPlot(const HarmonographParams &params, float animationTime, const PlotSettings &settings, const std::string &filename)
+{
+    enqueue(std::unique_ptr<Job>(new Job{PLOT, 0, ExtrudedMesh(), ExportSettings(), settings, params, animationTime, filename}));
+}
+
+unsigned long ExportWorker::enqueue(std::unique_ptr<Job> job)
+{
+    std::unique_ptr<Job> replaced;
+    unsigned long id;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+        {
+            return 0;
+        }
+        // the thread starts with the first job
+        if (!thread.joinable())
+        {
+            thread = std::thread(&ExportWorker::run, this);
+        }
+        id = job->id = nextId++;
+        // the replaced job is freed outside the lock
+        for (auto &waiting : queued)
+        {
+            if (waiting->kind == job->kind)
+            {
+                replaced.swap(waiting);
+                waiting.swap(job);
+                break;
+            }
+        }
+        if (job)
+        {
+            queued.push_back(std::move(job));
+        }
+    }
+    wake.notify_one();
+    return id;
+}
+
+void ExportWorker::cancel()
+{
+    std::deque<std::unique_ptr<Job>> dropped;
+    std::lock_guard<std::mutex> lock(mutex);
+    dropped.swap(queued);
+    progressState.cancelled = true;
+}
+
+void ExportWorker::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+ExportWorker::State ExportWorker::state() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentState;
+}
+
+ExportWorker::Kind ExportWorker::kind() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentKind;
+}
+
+size_t ExportWorker::queuedCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return queued.size();
+}
+
+std::string ExportWorker::filename() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return currentFilename;
+}
+
+size_t ExportWorker::plotMoves() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return moves;
+}
+
+unsigned long ExportWorker::lastSucceeded(Kind kind) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return succeeded[kind];
+}
+
+void ExportWorker::run()
+{
+    traceRecorder.setThreadName("Export");
+    for (;;)
+    {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return stopping || !queued.empty(); });
+            if (queued.empty())
+            {
+                return;
+            }
+            job.swap(queued.front());
+            queued.pop_front();
+            currentFilename = job->filename;
+            currentKind = job->kind;
+            currentState = EXPORTING;
+            progressState.cancelled = false;
+            progressState.beginStage(0.0f, 1.0f);
+        }
+
+        Kind kind = job->kind;
+        unsigned long id = job->id;
+        bool success;
+        size_t plotted = 0;
+        if (kind == PLOT)
+        {
+            TRACE_SCOPE("Plot");
+            success = exportPlot(job->params, job->animationTime, HARMONOGRAPH_STEP, job->filename, job->plot, &plotted);
+        }
+        else if (kind == DESIGN)
+        {
+            TRACE_SCOPE("Save design");
+            success = writeCurveCache(job->filename, job->params, job->animationTime, HARMONOGRAPH_STEP, CACHE_WITH_DERIVATIVES | CACHE_WITH_MESH);
+        }
+        else
+        {
+            TRACE_SCOPE("Export");
+            // Building the export mesh takes the first part of the bar, writing the rest
+            ExportMesh exportGeometry;
+            ExportSettings settings = job->settings;
+            progressState.beginStage(0.0f, 0.3f);
+            success = buildExportMesh(job->mesh, exportGeometry, settings.optimize, &progressState);
+            job.reset();
+            if (success)
+            {
+                progressState.beginStage(0.3f, 0.7f);
+                success = exportMesh(exportGeometry, currentFilename, settings, &progressState);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        currentState = success ? DONE : (progressState.cancelled ? CANCELLED : FAILED);
+        if (success)
+        {
+            succeeded[kind] = id;
+        }
+        if (kind == PLOT)
+        {
+            moves = plotted;
+        }
+    }
+}
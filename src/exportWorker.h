@@ -0,0 +1,101 @@
+#ifndef EXPORTWORKER_H
+#define EXPORTWORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "geometry.h"
+#include "meshExport.h"
+#include "plotExport.h"
+
+// Writes exported meshes, plots and saved designs on a background thread so the render loop never
+// waits for the disk. The render thread hands over what a job needs and only ever holds the lock briefly.
+class ExportWorker
+{
+public:
+    enum State
+    {
+        IDLE,
+        EXPORTING,
+        DONE,
+        FAILED,
+        CANCELLED
+    };
+
+    // What a job writes
+    enum Kind
+    {
+        MESH,   // an extruded mesh in one of the export formats
+        DESIGN, // a curve cache with derivatives and mesh
+        PLOT,   // the curve as a pen-plotter path
+        KIND_COUNT
+    };
+
+    ExportWorker();
+    ~ExportWorker();
+
+    // Queue the mesh (taken over without copying) for export. Jobs run in the order they are queued;
+    // a queued job of the same kind that has not started yet is replaced.
+    void submit(ExtrudedMesh &&mesh, const ExportSettings &settings, const std::string &filename);
+    // Queue evaluating the curve up to animationTime and writing it as a curve cache. Returns the id
+    // of the job, for lastSucceeded.
+    unsigned long submitDesign(const HarmonographParams &params, float animationTime, const std::string &filename);
+    // Queue evaluating the curve up to animationTime and writing it as a plot
+    void submitPlot(const HarmonographParams &params, float animationTime, const PlotSettings &settings, const std::string &filename);
+
+    // Cancel the running export and drop the queued jobs
+    void cancel();
+
+    // Finish the running and queued jobs, then stop the thread
+    void shutdown();
+
+    State state() const;
+    // Of the running or the last job
+    Kind kind() const;
+    size_t queuedCount() const;
+    // Of a running mesh export
+    float progress() const { return progressState.fraction; }
+    std::string filename() const;
+    // Moves written by the last plot that finished
+    size_t plotMoves() const;
+    // Id of the newest job of the kind that succeeded; 0 before any has
+    unsigned long lastSucceeded(Kind kind) const;
+
+private:
+    struct Job
+    {
+        Kind kind;
+        unsigned long id;
+        ExtrudedMesh mesh;
+        ExportSettings settings;
+        PlotSettings plot;
+        HarmonographParams params;
+        float animationTime;
+        std::string filename;
+    };
+
+    ExportWorker(const ExportWorker &);
+    ExportWorker &operator=(const ExportWorker &);
+
+    unsigned long enqueue(std::unique_ptr<Job> job);
+    void run();
+
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::unique_ptr<Job>> queued;
+    unsigned long nextId;
+    unsigned long succeeded[KIND_COUNT];
+    std::string currentFilename;
+    Kind currentKind;
+    State currentState;
+    size_t moves;
+    bool stopping;
+    ExportProgress progressState;
+};
+
+#endif //EXPORTWORKER_H
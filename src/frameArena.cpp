@@ -0,0 +1,79 @@
+#include "frameArena.h"
+
+#include <cstdint>
+
+FrameArena::FrameArena(size_t blockSize)
+    : blockSize(blockSize), current(), lastFrame()
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        ::operator delete(blocks[i].data);
+    }
+}
+
+void FrameArena::addBlock(size_t minSize)
+{
+    Block block;
+    block.size = minSize > blockSize ? minSize : blockSize;
+    block.data = (char *)::operator new(block.size);
+    block.used = 0;
+    blocks.push_back(block);
+
+    current.heapAllocations++;
+    current.capacity += block.size;
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment)
+{
+    if (blocks.empty())
+    {
+        addBlock(bytes + alignment);
+    }
+
+    Block *block = &blocks.back();
+    uintptr_t base = (uintptr_t)block->data;
+    size_t offset = ((base + block->used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    if (offset + bytes > block->size)
+    {
+        // the new block is at least as large as everything allocated so far, so growth is geometric
+        addBlock(bytes + alignment > current.capacity ? bytes + alignment : current.capacity);
+        block = &blocks.back();
+        base = (uintptr_t)block->data;
+        offset = ((base + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+    }
+
+    current.allocations++;
+    current.bytes += offset + bytes - block->used;
+    block->used = offset + bytes;
+    return block->data + offset;
+}
+
+void FrameArena::reset()
+{
+    lastFrame = current;
+    current.allocations = 0;
+    current.bytes = 0;
+    current.heapAllocations = 0;
+
+    // Merge the blocks of a frame that overflowed into one block that fits all of it
+    if (blocks.size() > 1)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            total += blocks[i].size;
+            ::operator delete(blocks[i].data);
+        }
+        blocks.clear();
+        current.capacity = 0;
+        addBlock(total);
+    }
+    else if (!blocks.empty())
+    {
+        blocks[0].used = 0;
+    }
+}
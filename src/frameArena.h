@@ -0,0 +1,96 @@
+#ifndef FRAMEARENA_H
+#define FRAMEARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/******************************************************************************/
+/*******************************   Frame Arena ********************************/
+/******************************************************************************/
+
+// Bump allocator for geometry that only lives for one frame. Allocations are never freed one by
+// one; reset() releases everything at once at the start of the next frame. When a frame needed
+// more than one block, the blocks are merged so the following frames fit in a single block and
+// stop touching the heap.
+class FrameArena
+{
+public:
+    struct Stats
+    {
+        size_t allocations;     // allocations served by the arena
+        size_t bytes;           // bytes handed out (including alignment padding)
+        size_t heapAllocations; // blocks the arena had to take from the heap
+        size_t capacity;        // bytes reserved by the arena
+    };
+
+    explicit FrameArena(size_t blockSize = 1 << 20);
+    ~FrameArena();
+
+    void *allocate(size_t bytes, size_t alignment);
+    void reset();
+
+    // counters of the last frame that was reset
+    const Stats &frameStats() const { return lastFrame; }
+
+private:
+    struct Block
+    {
+        char *data;
+        size_t size;
+        size_t used;
+    };
+
+    FrameArena(const FrameArena &);
+    FrameArena &operator=(const FrameArena &);
+
+    void addBlock(size_t minSize);
+
+    std::vector<Block> blocks;
+    size_t blockSize;
+    Stats current;
+    Stats lastFrame;
+};
+
+// std-compatible allocator that takes its memory from a FrameArena, or from the heap when it has
+// no arena (e.g. for geometry that outlives the frame)
+template <typename T>
+struct FrameAllocator
+{
+    typedef T value_type;
+
+    FrameArena *arena;
+
+    FrameAllocator() : arena(nullptr) {}
+    explicit FrameAllocator(FrameArena *arena) : arena(arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n)
+    {
+        if (arena)
+        {
+            return (T *)arena->allocate(n * sizeof(T), alignof(T));
+        }
+        return (T *)::operator new(n * sizeof(T));
+    }
+
+    void deallocate(T *p, size_t)
+    {
+        if (!arena)
+        {
+            ::operator delete(p);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const FrameAllocator<T> &a, const FrameAllocator<U> &b) { return a.arena == b.arena; }
+
+template <typename T, typename U>
+bool operator!=(const FrameAllocator<T> &a, const FrameAllocator<U> &b) { return a.arena != b.arena; }
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+
+#endif //FRAMEARENA_H
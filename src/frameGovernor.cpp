@@ -0,0 +1,149 @@
+#include "frameGovernor.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "geometry.h"
+
+///=========================================================================================///
+///                                       Frame Governor
+///=========================================================================================///
+
+FrameGovernor::FrameGovernor()
+    : targetSeconds(GOVERNOR_DEFAULT_TARGET), geometry(-1.0f), other(-1.0f), current(0), overBudget(0), underBudget(0), settle(0), enabled(false)
+{
+}
+
+void FrameGovernor::setEnabled(bool enable)
+{
+    enabled = enable;
+    if (!enabled)
+    {
+        changeLevel(0);
+        geometry = other = -1.0f;
+    }
+}
+
+float FrameGovernor::step() const
+{
+    return HARMONOGRAPH_STEP * std::pow(GOVERNOR_LEVEL_RATIO, (float)current);
+}
+
+void FrameGovernor::update(float geometrySeconds, float otherSeconds)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    if (geometry < 0.0f)
+    {
+        geometry = geometrySeconds;
+        other = otherSeconds;
+    }
+    else
+    {
+        geometry += GOVERNOR_SMOOTHING * (geometrySeconds - geometry);
+        other += GOVERNOR_SMOOTHING * (otherSeconds - other);
+    }
+
+    // Frames right after a change still show the old level, or a result the worker built for it
+    if (settle > 0)
+    {
+        --settle;
+        return;
+    }
+
+    bool over = geometry + other > GOVERNOR_COARSEN_ABOVE * targetSeconds;
+    bool finerFits = geometry * GOVERNOR_LEVEL_RATIO + other < GOVERNOR_REFINE_BELOW * targetSeconds;
+    overBudget = over ? overBudget + 1 : 0;
+    underBudget = finerFits ? underBudget + 1 : 0;
+
+    if (overBudget >= GOVERNOR_COARSEN_FRAMES && current < GOVERNOR_LEVELS - 1)
+    {
+        changeLevel(current + 1);
+    }
+    else if (underBudget >= GOVERNOR_REFINE_FRAMES && current > 0)
+    {
+        changeLevel(current - 1);
+    }
+}
+
+void FrameGovernor::changeLevel(int level)
+{
+    if (level == current)
+    {
+        return;
+    }
+
+    // Expect the geometry to cost in proportion to the samples, until frames at the new level say otherwise
+    if (geometry >= 0.0f)
+    {
+        geometry *= std::pow(GOVERNOR_LEVEL_RATIO, (float)(current - level));
+    }
+    current = level;
+    overBudget = underBudget = 0;
+    settle = GOVERNOR_SETTLE_FRAMES;
+}
+
+///=========================================================================================///
+///                                     Resolution Governor
+///=========================================================================================///
+
+ResolutionGovernor::ResolutionGovernor() : current(1.0f), scene(-1.0f), other(-1.0f), settle(0), enabled(false)
+{
+}
+
+void ResolutionGovernor::setScale(float scale)
+{
+    current = std::min(std::max(scale, RESOLUTION_SCALE_MIN), 1.0f);
+    scene = other = -1.0f;
+}
+
+void ResolutionGovernor::update(float sceneSeconds, float otherSeconds, float targetSeconds)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    if (scene < 0.0f)
+    {
+        scene = sceneSeconds;
+        other = otherSeconds;
+    }
+    else
+    {
+        scene += GOVERNOR_SMOOTHING * (sceneSeconds - scene);
+        other += GOVERNOR_SMOOTHING * (otherSeconds - other);
+    }
+
+    // GPU times arrive a few frames late, so the first frames after a change still show the old scale
+    if (settle > 0)
+    {
+        --settle;
+        return;
+    }
+
+    // The scale whose scene time fits into what the rest of the frame leaves over
+    float available = RESOLUTION_HEADROOM * targetSeconds - other;
+    float wanted = RESOLUTION_SCALE_MIN;
+    if (available > 0.0f)
+    {
+        wanted = scene > 0.0f ? current * std::sqrt(available / scene) : 1.0f;
+    }
+    wanted = std::min(std::max(wanted, RESOLUTION_SCALE_MIN), 1.0f);
+
+    float next = current;
+    if (wanted < current - RESOLUTION_SCALE_QUANTUM || wanted >= current + 2.0f * RESOLUTION_SCALE_QUANTUM || (wanted == 1.0f && current < 1.0f))
+    {
+        next = std::floor(wanted / RESOLUTION_SCALE_QUANTUM + 0.001f) * RESOLUTION_SCALE_QUANTUM;
+        next = std::min(std::max(next, RESOLUTION_SCALE_MIN), 1.0f);
+    }
+    if (next != current)
+    {
+        scene *= (next * next) / (current * current);
+        current = next;
+        settle = GOVERNOR_SETTLE_FRAMES;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef FRAMEGOVERNOR_H
+#define FRAMEGOVERNOR_H
+
+#define GOVERNOR_LEVELS 8                // quality levels; level 0 samples the curve every HARMONOGRAPH_STEP
+#define GOVERNOR_LEVEL_RATIO 1.41421356f // the step grows by this factor from one level to the next
+#define GOVERNOR_DEFAULT_TARGET (1.0f / 60.0f)
+#define GOVERNOR_SMOOTHING 0.1f    // weight of the newest frame in the running average
+#define GOVERNOR_COARSEN_ABOVE 1.0f // of the target, for the average frame
+#define GOVERNOR_REFINE_BELOW 0.75f // of the target, for the average frame predicted at the next finer level
+#define GOVERNOR_COARSEN_FRAMES 5   // frames in a row over budget before a coarser level is taken
+#define GOVERNOR_REFINE_FRAMES 30   // frames in a row with time to spare before a finer level is taken
+#define GOVERNOR_SETTLE_FRAMES 10   // frames after a change of level before the next decision
+
+#define RESOLUTION_SCALE_MIN 0.5f      // of the window size on each axis
+#define RESOLUTION_SCALE_QUANTUM 0.05f // scales are multiples of this, so small swings do not reallocate the target
+#define RESOLUTION_HEADROOM 0.9f       // of the target, aimed for when picking a scale
+
+/******************************************************************************/
+/*******************************   Frame Governor *****************************/
+/******************************************************************************/
+
+// Picks the curve sampling step that keeps the frame time at a target. The extruded mesh is built per
+// sample, so its density follows the step. Geometry work is taken to scale with the number of samples;
+// the rest of the frame is not. A coarser level is taken quickly when frames run over budget, and a
+// finer one only after the finer level has been predicted to fit with room to spare for a while, so
+// the level does not flip back and forth at the edge of the budget.
+class FrameGovernor
+{
+public:
+    FrameGovernor();
+
+    void setEnabled(bool enable);
+    bool isEnabled() const { return enabled; }
+    void setTarget(float seconds) { targetSeconds = seconds; }
+    float target() const { return targetSeconds; }
+
+    // Feed the seconds a frame spent on the geometry (evaluation, meshing, upload and draw) and on
+    // everything else except waiting for the swap
+    void update(float geometrySeconds, float otherSeconds);
+
+    int level() const { return current; }
+    // Time between two curve samples at the current level
+    float step() const;
+    // Running averages of what update was given
+    float averageGeometry() const { return geometry; }
+    float averageFrame() const { return geometry + other; }
+
+private:
+    void changeLevel(int level);
+
+    float targetSeconds;
+    float geometry, other; // running averages; negative before the first frame
+    int current;
+    int overBudget, underBudget; // frames in a row
+    int settle;
+    bool enabled;
+};
+
+// Picks the resolution the scene is drawn at, from the GPU time of the frame. The scene pass is taken
+// to cost in proportion to its pixels, so the next scale is solved for directly instead of stepped
+// towards. Going down takes one quantum of difference, going up two, so the scale settles.
+class ResolutionGovernor
+{
+public:
+    ResolutionGovernor();
+
+    void setEnabled(bool enable) { enabled = enable; }
+    bool isEnabled() const { return enabled; }
+    // Scale used while disabled
+    void setScale(float scale);
+    float scale() const { return current; }
+
+    // Feed the GPU seconds a frame spent on the scene, which scales with its pixels, and on everything
+    // else, to be held at targetSeconds
+    void update(float sceneSeconds, float otherSeconds, float targetSeconds);
+
+private:
+    float current;
+    float scene, other; // running averages; negative before the first frame
+    int settle;
+    bool enabled;
+};
+
+#endif //FRAMEGOVERNOR_H
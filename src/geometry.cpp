@@ -0,0 +1,429 @@
+#include "geometry.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "parallel.h"
+#include "profiler.h"
+
+///=========================================================================================///
+///                                  Harmonograph Evaluation
+///=========================================================================================///
+
+size_t harmonographSampleCount(float animationTime, float step)
+{
+    if (animationTime <= 0.0f || step <= 0.0f)
+    {
+        return 0;
+    }
+    return (size_t)std::ceil(animationTime / step);
+}
+
+// Evaluate one sample. Each term is A sin(wt + p) e^(-dt), so the first and second derivatives
+// have a closed form and reuse the sin/cos/exp values of the position.
+static inline void evaluateSample(const HarmonographParams &params, float time, glm::vec3 &position, glm::vec3 *velocity, glm::vec3 *acceleration)
+{
+    // per-term frequency, phase and damping, ordered x1 x2 y1 y2 z1 z2
+    // (the second z term has always used the phase of y1)
+    const float w[6] = {params.freq1[0], params.freq1[1], params.freq1[2], params.freq2[0], params.freq2[1], params.freq2[2]};
+    const float p[6] = {params.phase1[0], params.phase1[1], params.phase1[2], params.phase2[0], params.phase2[1], params.phase1[2]};
+    const float d[6] = {params.damp1[0], params.damp1[1], params.damp1[2], params.damp2[0], params.damp2[1], params.damp2[2]};
+
+    float pos[3] = {0.0f, 0.0f, 0.0f};
+    float vel[3] = {0.0f, 0.0f, 0.0f};
+    float acc[3] = {0.0f, 0.0f, 0.0f};
+
+    for (int k = 0; k < 6; ++k)
+    {
+        float s = std::sin(time * w[k] + p[k]);
+        float e = params.amplitude * std::exp(-d[k] * time);
+        pos[k / 2] += e * s;
+
+        if (velocity || acceleration)
+        {
+            float c = std::cos(time * w[k] + p[k]);
+            vel[k / 2] += e * (w[k] * c - d[k] * s);
+            acc[k / 2] += e * ((d[k] * d[k] - w[k] * w[k]) * s - 2.0f * d[k] * w[k] * c);
+        }
+    }
+
+    position = glm::vec3(pos[0], pos[1], pos[2]);
+    if (velocity)
+    {
+        *velocity = glm::vec3(vel[0], vel[1], vel[2]);
+    }
+    if (acceleration)
+    {
+        *acceleration = glm::vec3(acc[0], acc[1], acc[2]);
+    }
+}
+
+void evaluateHarmonograph(const HarmonographParams &params, float step, size_t count, glm::vec3 *positions, glm::vec3 *velocities, glm::vec3 *accelerations)
+{
+    PROFILE_SCOPE(PROFILE_EVALUATE);
+    for (size_t i = 0; i < count; ++i)
+    {
+        evaluateSample(params, i * step, positions[i], velocities ? &velocities[i] : nullptr, accelerations ? &accelerations[i] : nullptr);
+    }
+}
+
+void calculateTangents(const glm::vec3 *velocities, size_t count, glm::vec3 *tangents)
+{
+    glm::vec3 previous(1.0f, 0.0f, 0.0f);
+    for (size_t i = 0; i < count; ++i)
+    {
+        float speed = glm::length(velocities[i]);
+        // The pen can momentarily stop (e.g. undamped presets); keep the last direction there
+        tangents[i] = speed > 0.0f ? velocities[i] / speed : previous;
+        previous = tangents[i];
+    }
+}
+
+float calculateCurvature(const glm::vec3 &velocity, const glm::vec3 &acceleration)
+{
+    float speed = glm::length(velocity);
+    if (speed <= 0.0f)
+    {
+        return 0.0f;
+    }
+    return glm::length(glm::cross(velocity, acceleration)) / (speed * speed * speed);
+}
+
+///=========================================================================================///
+///                          Vertex Normals + Surfaces + Extrusions
+///=========================================================================================///
+
+#define STRIP_NORMAL_BLOCK 256      // strip positions whose triangle normals are kept on the stack at once
+#define STRIP_NORMAL_CHUNK 32768    // strip positions per parallel task
+#define PARALLEL_NORMALS_MIN 100000 // below this many strip positions the thread hand-off costs more than it saves
+
+// Normal of triangle i of a strip. Strip triangles alternate their winding, so every other one is
+// flipped to make all of them face the same side.
+static inline glm::vec3 stripTriangleNormal(const glm::vec3 *vertices, const unsigned int *indices, size_t i)
+{
+    const glm::vec3 &v0 = vertices[indices ? indices[i] : i];
+    const glm::vec3 &v1 = vertices[indices ? indices[i + 1] : i + 1];
+    const glm::vec3 &v2 = vertices[indices ? indices[i + 2] : i + 2];
+
+    glm::vec3 triangleNormal = glm::cross(v1 - v0, v2 - v0);
+    return (i % 2 == 0) ? triangleNormal : -triangleNormal;
+}
+
+// Normals of strip positions [begin, end). Position k gathers triangles k-2, k-1 and k, so a range
+// only reads a halo of two triangles in front of it and writes nothing outside itself; any split
+// into ranges gives the same result.
+static void calculateStripNormalRange(const glm::vec3 *vertices, const unsigned int *indices, size_t count, glm::vec3 *normals, bool invertNormals, size_t begin, size_t end)
+{
+    size_t triangles = count >= 3 ? count - 2 : 0;
+    glm::vec3 triangleNormals[STRIP_NORMAL_BLOCK + 2];
+
+    for (size_t blockBegin = begin; blockBegin < end; blockBegin += STRIP_NORMAL_BLOCK)
+    {
+        size_t blockEnd = std::min(end, blockBegin + STRIP_NORMAL_BLOCK);
+
+        size_t first = blockBegin >= 2 ? blockBegin - 2 : 0;
+        size_t last = std::min(blockEnd, triangles);
+        for (size_t i = first; i < last; ++i)
+        {
+            triangleNormals[i - first] = stripTriangleNormal(vertices, indices, i);
+        }
+
+        for (size_t k = blockBegin; k < blockEnd; ++k)
+        {
+            glm::vec3 normal(0.0f);
+            for (size_t i = k >= 2 ? k - 2 : 0; i <= k && i < last; ++i)
+            {
+                normal += triangleNormals[i - first];
+            }
+
+            if (glm::length(normal) > 0.0f)
+            {
+                normal = glm::normalize(normal);
+            }
+
+            // Invert when necessary
+            normals[k] = invertNormals ? -normal : normal;
+        }
+    }
+}
+
+void calculateTriangleStripNormals(const glm::vec3 *vertices, const unsigned int *indices, size_t count, glm::vec3 *normals, bool invertNormals)
+{
+    calculateStripNormalRange(vertices, indices, count, normals, invertNormals, 0, count);
+}
+
+// A chunk of a strip whose normals are computed as one task
+struct StripNormalJob
+{
+    const glm::vec3 *vertices;
+    const unsigned int *indices;
+    size_t count;
+    glm::vec3 *normals;
+    bool invertNormals;
+    size_t begin, end;
+};
+
+static size_t addStripNormalJobs(FrameVector<StripNormalJob> &jobs, const glm::vec3 *vertices, const unsigned int *indices, size_t count, glm::vec3 *normals, bool invertNormals = false)
+{
+    for (size_t begin = 0; begin < count; begin += STRIP_NORMAL_CHUNK)
+    {
+        StripNormalJob job = {vertices, indices, count, normals, invertNormals, begin, std::min(count, begin + STRIP_NORMAL_CHUNK)};
+        jobs.push_back(job);
+    }
+    return count;
+}
+
+// Run the jobs on the thread pool once there is enough work to pay for it
+static void runStripNormalJobs(const FrameVector<StripNormalJob> &jobs, size_t totalCount)
+{
+    auto run = [&jobs](size_t i)
+    {
+        const StripNormalJob &job = jobs[i];
+        calculateStripNormalRange(job.vertices, job.indices, job.count, job.normals, job.invertNormals, job.begin, job.end);
+    };
+
+    if (totalCount < PARALLEL_NORMALS_MIN)
+    {
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            run(i);
+        }
+        return;
+    }
+    parallelFor(jobs.size(), run);
+}
+
+void extrudeSurface(const glm::vec3 *surfaceVertices, const glm::vec3 *surfaceNormals, size_t numVertices, float extrusionDistance, ExtrudedMesh &mesh)
+{
+    mesh.vertices.resize(2 * numVertices);
+
+    for (size_t i = 0; i < numVertices; ++i)
+    {
+        // Top surface: extrude each vertex along its normal direction
+        mesh.vertices[i] = surfaceVertices[i] + extrusionDistance * surfaceNormals[i];
+        // Bottom surface: the original surface vertices
+        mesh.vertices[numVertices + i] = surfaceVertices[i];
+    }
+
+    size_t sizes[SURFACE_COUNT] = {numVertices, numVertices, 4, 4, 2 * ((numVertices + 1) / 2), 2 * (numVertices / 2)};
+    mesh.surfaceStart[0] = 0;
+    for (int s = 0; s < SURFACE_COUNT; ++s)
+    {
+        mesh.surfaceStart[s + 1] = mesh.surfaceStart[s] + sizes[s];
+    }
+    mesh.indices.resize(mesh.surfaceStart[SURFACE_COUNT]);
+
+    unsigned int n = numVertices;
+    unsigned int *top = mesh.indices.data() + mesh.surfaceStart[SURFACE_TOP];
+    unsigned int *bottom = mesh.indices.data() + mesh.surfaceStart[SURFACE_BOTTOM];
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        top[i] = i;
+        bottom[i] = n + i;
+    }
+
+    // create indices for front + end surface
+    unsigned int *front = mesh.indices.data() + mesh.surfaceStart[SURFACE_FRONT];
+    front[0] = 0;
+    front[1] = n;
+    front[2] = 1;
+    front[3] = n + 1;
+
+    unsigned int *end = mesh.indices.data() + mesh.surfaceStart[SURFACE_END];
+    end[0] = n - 1;
+    end[1] = 2 * n - 1;
+    end[2] = n - 2;
+    end[3] = 2 * n - 2;
+
+    // create indices for side faces
+    unsigned int *side1 = mesh.indices.data() + mesh.surfaceStart[SURFACE_SIDE1];
+    for (unsigned int i = 0; i < n; i += 2)
+    {
+        *side1++ = i;
+        *side1++ = i + n;
+    }
+    unsigned int *side2 = mesh.indices.data() + mesh.surfaceStart[SURFACE_SIDE2];
+    for (unsigned int i = 1; i < n; i += 2)
+    {
+        *side2++ = i;
+        *side2++ = i + n;
+    }
+}
+
+// Ribbon edge of a sample: the point along its exact tangent. Where the pen stops the tangent keeps
+// the last direction.
+static inline glm::vec3 ribbonEdge(const glm::vec3 &position, const glm::vec3 &velocity, glm::vec3 &tangent)
+{
+    float speed = glm::length(velocity);
+    if (speed > 0.0f)
+    {
+        tangent = velocity / speed;
+    }
+    return position + RIBBON_WIDTH * tangent;
+}
+
+// Ribbon normals, extrusion and strip normals of the ribbon in mesh.ribbon
+static void extrudeRibbon(ExtrudedMesh &mesh)
+{
+    // The front and end caps need at least two ribbon segments
+    if (mesh.ribbon.size() < 4)
+    {
+        mesh.vertices.clear();
+        mesh.indices.clear();
+        mesh.normals.clear();
+        for (int s = 0; s <= SURFACE_COUNT; ++s)
+        {
+            mesh.surfaceStart[s] = 0;
+        }
+        return;
+    }
+
+    FrameVector<StripNormalJob> jobs(mesh.normals.get_allocator());
+
+    {
+        PROFILE_SCOPE(PROFILE_NORMALS);
+        mesh.ribbonNormals.resize(mesh.ribbon.size());
+        size_t ribbonCount = addStripNormalJobs(jobs, mesh.ribbon.data(), nullptr, mesh.ribbon.size(), mesh.ribbonNormals.data());
+        runStripNormalJobs(jobs, ribbonCount);
+    }
+
+    {
+        PROFILE_SCOPE(PROFILE_EXTRUDE);
+        extrudeSurface(mesh.ribbon.data(), mesh.ribbonNormals.data(), mesh.ribbon.size(), EXTRUSION_DISTANCE, mesh);
+    }
+
+    // The six surfaces are independent; their chunks all go to the pool together
+    PROFILE_SCOPE(PROFILE_NORMALS);
+    jobs.clear();
+    mesh.normals.resize(mesh.indices.size());
+    for (int s = 0; s < SURFACE_COUNT; ++s)
+    {
+        size_t start = mesh.surfaceStart[s];
+        addStripNormalJobs(jobs, mesh.vertices.data(), mesh.indices.data() + start, mesh.surfaceSize(s), mesh.normals.data() + start, s == SURFACE_TOP);
+    }
+    runStripNormalJobs(jobs, mesh.indices.size());
+}
+
+void buildExtrudedMesh(const HarmonographParams &params, float animationTime, float step, ExtrudedMesh &mesh)
+{
+    size_t count = harmonographSampleCount(animationTime, step);
+    // the last samples do not get a ribbon segment
+    size_t ribbonSamples = count > 4 ? count - 4 : 0;
+
+    mesh.curve.resize(count);
+    mesh.ribbon.resize(2 * ribbonSamples);
+
+    // Evaluate each sample and place its ribbon edge along the exact tangent in the same loop
+    {
+        PROFILE_SCOPE(PROFILE_EVALUATE);
+        glm::vec3 tangent(1.0f, 0.0f, 0.0f);
+        for (size_t i = 0; i < count; ++i)
+        {
+            glm::vec3 velocity;
+            evaluateSample(params, i * step, mesh.curve[i], &velocity, nullptr);
+
+            if (i < ribbonSamples)
+            {
+                mesh.ribbon[2 * i] = mesh.curve[i];
+                mesh.ribbon[2 * i + 1] = ribbonEdge(mesh.curve[i], velocity, tangent);
+            }
+        }
+    }
+
+    extrudeRibbon(mesh);
+}
+
+void interleaveExtrudedMesh(const ExtrudedMesh &mesh, glm::vec3 *out)
+{
+    for (size_t k = 0; k < mesh.indices.size(); ++k)
+    {
+        out[2 * k] = mesh.vertices[mesh.indices[k]];
+        out[2 * k + 1] = mesh.normals[k];
+    }
+}
+
+///=========================================================================================///
+///                                     Streamed Extrusion
+///=========================================================================================///
+
+// The window starts at an even ribbon position, so a position is on the same side strip in the
+// window as in the whole extrusion: even positions on SIDE1, odd ones on SIDE2.
+
+const glm::vec3 &ExtrudedMeshChunk::topNormal(size_t k) const
+{
+    return window->normals[window->surfaceStart[SURFACE_TOP] + k - windowBegin];
+}
+
+const glm::vec3 &ExtrudedMeshChunk::bottomNormal(size_t k) const
+{
+    return window->normals[window->surfaceStart[SURFACE_BOTTOM] + k - windowBegin];
+}
+
+const glm::vec3 &ExtrudedMeshChunk::sideTopNormal(size_t k) const
+{
+    size_t j = k - windowBegin;
+    return j % 2 == 0 ? window->normals[window->surfaceStart[SURFACE_SIDE1] + j] : window->normals[window->surfaceStart[SURFACE_SIDE2] + j - 1];
+}
+
+const glm::vec3 &ExtrudedMeshChunk::sideBottomNormal(size_t k) const
+{
+    size_t j = k - windowBegin;
+    return j % 2 == 0 ? window->normals[window->surfaceStart[SURFACE_SIDE1] + j + 1] : window->normals[window->surfaceStart[SURFACE_SIDE2] + j];
+}
+
+ExtrudedMeshStream::ExtrudedMeshStream(const HarmonographParams &params, float animationTime, float step, size_t chunkSamples)
+    : params(params), step(step), chunkSamples(std::max<size_t>(chunkSamples, 1))
+{
+    size_t count = harmonographSampleCount(animationTime, step);
+    // same ribbon as buildExtrudedMesh, which needs at least two ribbon segments
+    ribbonSamples = count > 4 ? count - 4 : 0;
+    if (ribbonSamples < 2)
+    {
+        ribbonSamples = 0;
+    }
+    rewind();
+}
+
+void ExtrudedMeshStream::rewind()
+{
+    chunkBegin = 0;
+    windowBegin = windowEnd = 0;
+    tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+    window.ribbon.clear();
+}
+
+bool ExtrudedMeshStream::next(ExtrudedMeshChunk &chunk)
+{
+    if (chunkBegin >= ribbonSamples)
+    {
+        return false;
+    }
+    size_t chunkEnd = std::min(ribbonSamples, chunkBegin + chunkSamples);
+
+    // Slide the window: drop the samples the halo no longer needs, then evaluate the new ones in
+    // order so the tangent carries over exactly as in buildExtrudedMesh
+    size_t newBegin = chunkBegin > STREAM_HALO_SAMPLES ? chunkBegin - STREAM_HALO_SAMPLES : 0;
+    size_t newEnd = std::min(ribbonSamples, chunkEnd + STREAM_HALO_SAMPLES);
+    window.ribbon.erase(window.ribbon.begin(), window.ribbon.begin() + 2 * (newBegin - windowBegin));
+    windowBegin = newBegin;
+
+    window.ribbon.resize(2 * (newEnd - windowBegin));
+    for (size_t i = windowEnd; i < newEnd; ++i)
+    {
+        glm::vec3 position, velocity;
+        evaluateSample(params, i * step, position, &velocity, nullptr);
+        window.ribbon[2 * (i - windowBegin)] = position;
+        window.ribbon[2 * (i - windowBegin) + 1] = ribbonEdge(position, velocity, tangent);
+    }
+    windowEnd = newEnd;
+
+    // Positions near a cut edge of the window come out wrong; the halo keeps them outside the chunk
+    extrudeRibbon(window);
+
+    chunk.begin = 2 * chunkBegin;
+    chunk.end = 2 * chunkEnd;
+    chunk.windowBegin = 2 * windowBegin;
+    chunk.window = &window;
+    chunkBegin = chunkEnd;
+    return true;
+}
@@ -0,0 +1,152 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <cstddef>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frameArena.h"
+
+#define HARMONOGRAPH_STEP 0.01f     // time between two curve samples
+#define RIBBON_WIDTH 0.5f           // distance from the curve to the far edge of the flat surface
+#define EXTRUSION_DISTANCE 0.1f     // thickness of the extruded surface
+
+/******************************************************************************/
+/****************************   Harmonograph Curve ****************************/
+/******************************************************************************/
+
+// Pendulum parameters; each axis is the sum of two damped sinusoids
+struct HarmonographParams
+{
+    float amplitude;
+    float freq1[3];
+    float freq2[3];
+    float damp1[3];
+    float damp2[3];
+    float phase1[3];
+    float phase2[3];
+};
+
+// Number of samples the evaluator produces for a curve drawn up to animationTime
+size_t harmonographSampleCount(float animationTime, float step);
+
+// Evaluate count samples at i * step; velocities and accelerations are optional (nullptr to skip)
+void evaluateHarmonograph(const HarmonographParams &params, float step, size_t count, glm::vec3 *positions,
+                          glm::vec3 *velocities = nullptr, glm::vec3 *accelerations = nullptr);
+
+// Exact unit tangents from the analytic velocities of evaluateHarmonograph
+void calculateTangents(const glm::vec3 *velocities, size_t count, glm::vec3 *tangents);
+
+// Curvature |v x a| / |v|^3 of a sample from its analytic velocity and acceleration
+float calculateCurvature(const glm::vec3 &velocity, const glm::vec3 &acceleration);
+
+/******************************************************************************/
+/****************************   Extruded Surface ******************************/
+/******************************************************************************/
+
+// Surfaces of the extrusion, in the order their strips are stored in ExtrudedMesh
+enum Surface
+{
+    SURFACE_TOP,
+    SURFACE_BOTTOM,
+    SURFACE_FRONT,
+    SURFACE_END,
+    SURFACE_SIDE1,
+    SURFACE_SIDE2,
+    SURFACE_COUNT
+};
+
+// All geometry of one extruded curve. Meshes built for a single frame take their memory from the
+// frame arena; without an arena the buffers live on the heap.
+struct ExtrudedMesh
+{
+    FrameVector<glm::vec3> curve;         // curve samples
+    FrameVector<glm::vec3> ribbon;        // flat surface: each sample and its point along the tangent
+    FrameVector<glm::vec3> ribbonNormals; // normals of the flat surface
+    FrameVector<glm::vec3> vertices;      // extruded vertices, top surface then bottom surface
+    FrameVector<unsigned int> indices;    // triangle strips of all surfaces back to back
+    FrameVector<glm::vec3> normals;       // one normal per strip index (parallel to indices)
+    size_t surfaceStart[SURFACE_COUNT + 1];
+
+    explicit ExtrudedMesh(FrameArena *arena = nullptr)
+        : curve(FrameAllocator<glm::vec3>(arena)), ribbon(FrameAllocator<glm::vec3>(arena)),
+          ribbonNormals(FrameAllocator<glm::vec3>(arena)), vertices(FrameAllocator<glm::vec3>(arena)),
+          indices(FrameAllocator<unsigned int>(arena)), normals(FrameAllocator<glm::vec3>(arena)), surfaceStart()
+    {
+    }
+
+    size_t surfaceSize(int surface) const { return surfaceStart[surface + 1] - surfaceStart[surface]; }
+};
+
+// Normals of a triangle strip, averaged from the triangles around each position; normals[k] belongs
+// to strip position k. indices may be nullptr for a strip that runs over the vertices in order.
+void calculateTriangleStripNormals(const glm::vec3 *vertices, const unsigned int *indices, size_t count, glm::vec3 *normals, bool invertNormals = false);
+
+// Extrude the flat surface along its normals and build the strips of the six surfaces
+void extrudeSurface(const glm::vec3 *surfaceVertices, const glm::vec3 *surfaceNormals, size_t numVertices, float extrusionDistance, ExtrudedMesh &mesh);
+
+// Evaluate, frame, ribbon and extrude the curve in one pass over the mesh buffers. Strip normals of
+// large meshes are computed in parallel chunks; the result does not depend on the thread count.
+void buildExtrudedMesh(const HarmonographParams &params, float animationTime, float step, ExtrudedMesh &mesh);
+
+// Write one (position, normal) pair per strip index, ready to draw each surface with glDrawArrays
+void interleaveExtrudedMesh(const ExtrudedMesh &mesh, glm::vec3 *out);
+
+/******************************************************************************/
+/****************************   Streamed Extrusion ****************************/
+/******************************************************************************/
+
+#define STREAM_CHUNK_SAMPLES 65536 // curve samples each chunk of a streamed extrusion adds
+#define STREAM_HALO_SAMPLES 4      // samples kept on both sides of a chunk so its normals are exact
+
+// Part of a streamed extrusion. window is the extrusion of the ribbon positions from windowBegin on;
+// vertices are exact from three positions before begin, normals from begin to end.
+struct ExtrudedMeshChunk
+{
+    size_t begin, end;  // ribbon positions this chunk adds
+    size_t windowBegin; // ribbon position of the first vertex in window
+    const ExtrudedMesh *window;
+
+    const glm::vec3 &top(size_t k) const { return window->vertices[k - windowBegin]; }
+    const glm::vec3 &bottom(size_t k) const { return window->vertices[window->ribbon.size() + k - windowBegin]; }
+
+    // Normal of ribbon position k on the top, bottom and side strips
+    const glm::vec3 &topNormal(size_t k) const;
+    const glm::vec3 &bottomNormal(size_t k) const;
+    const glm::vec3 &sideTopNormal(size_t k) const;
+    const glm::vec3 &sideBottomNormal(size_t k) const;
+
+    // Normals of the front cap (first chunk only) and the end cap (last chunk only)
+    const glm::vec3 *frontNormals() const { return &window->normals[window->surfaceStart[SURFACE_FRONT]]; }
+    const glm::vec3 *endNormals() const { return &window->normals[window->surfaceStart[SURFACE_END]]; }
+};
+
+// Builds the extrusion of buildExtrudedMesh chunk by chunk with a window of fixed size that slides
+// along the curve, so memory use does not depend on the length of the curve. Every sample is
+// evaluated once, and the vertices and normals are exactly those of buildExtrudedMesh.
+class ExtrudedMeshStream
+{
+public:
+    ExtrudedMeshStream(const HarmonographParams &params, float animationTime, float step, size_t chunkSamples = STREAM_CHUNK_SAMPLES);
+
+    // Ribbon positions of the whole extrusion; 0 when the curve is too short to extrude
+    size_t ribbonSize() const { return 2 * ribbonSamples; }
+
+    // Produce the next chunk; false after the last one. The chunk stays valid until the next call.
+    bool next(ExtrudedMeshChunk &chunk);
+
+    // Start again from the first chunk
+    void rewind();
+
+private:
+    HarmonographParams params;
+    float step;
+    size_t ribbonSamples, chunkSamples;
+    size_t chunkBegin;               // first sample of the next chunk
+    size_t windowBegin, windowEnd;   // samples held in window
+    glm::vec3 tangent;               // tangent of the last sample evaluated
+    ExtrudedMesh window;
+};
+
+#endif //GEOMETRY_H
@@ -0,0 +1,133 @@
+#include "geometryWorker.h"
+
+#include <chrono>
+#include <cstring>
+
+#include "traceRecorder.h"
+
+///=========================================================================================///
+///                                      Geometry Worker
+///=========================================================================================///
+
+GeometryWorker::GeometryWorker()
+    : last(), submitted(0), completed(0), hasResult(false), stopping(false)
+{
+}
+
+GeometryWorker::~GeometryWorker()
+{
+    shutdown();
+}
+
+bool GeometryWorker::request(const HarmonographParams &params, float animationTime, float step, bool renderSurface)
+{
+    if (submitted != 0 && memcmp(&params, &last.params, sizeof(params)) == 0 && animationTime == last.animationTime &&
+        step == last.step && renderSurface == last.renderSurface)
+    {
+        return true;
+    }
+
+    GeometryRequest next = {submitted + 1, params, animationTime, step, renderSurface};
+    if (!queue.push(next))
+    {
+        return false;
+    }
+    last = next;
+    submitted = next.id;
+
+    // The thread starts with the first request. Taking the mutex orders the push before the
+    // worker's check of the queue, so the wake-up cannot be missed.
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!thread.joinable() && !stopping)
+        {
+            thread = std::thread(&GeometryWorker::run, this);
+        }
+    }
+    wake.notify_one();
+    return true;
+}
+
+const GeometryResult *GeometryWorker::newest()
+{
+    bool fresh;
+    const GeometryResult &result = results.readSlot(fresh);
+    hasResult = hasResult || fresh;
+    return hasResult ? &result : nullptr;
+}
+
+void GeometryWorker::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+void GeometryWorker::run()
+{
+    traceRecorder.setThreadName("Geometry");
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return stopping || !queue.empty(); });
+            if (stopping)
+            {
+                return;
+            }
+        }
+
+        // Only the newest request is worth building
+        GeometryRequest request, next;
+        queue.pop(request);
+        while (queue.pop(next))
+        {
+            request = next;
+        }
+
+        build(request, results.writeSlot());
+        results.publish();
+        completed.store(request.id, std::memory_order_release);
+    }
+}
+
+// The same work drawHarmonograph does on the render thread, into host memory
+void GeometryWorker::build(const GeometryRequest &request, GeometryResult &result)
+{
+    TRACE_SCOPE("Build geometry");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    arena.reset();
+
+    size_t count = harmonographSampleCount(request.animationTime, request.step);
+    result.curve.resize(count);
+    result.mesh.clear();
+    memset(result.surfaceStart, 0, sizeof(result.surfaceStart));
+    if (request.renderSurface && count)
+    {
+        ExtrudedMesh mesh(&arena);
+        buildExtrudedMesh(request.params, request.animationTime, request.step, mesh);
+        memcpy(result.curve.data(), mesh.curve.data(), count * sizeof(glm::vec3));
+        if (!mesh.indices.empty())
+        {
+            result.mesh.resize(mesh.indices.size() * 2);
+            interleaveExtrudedMesh(mesh, result.mesh.data());
+            memcpy(result.surfaceStart, mesh.surfaceStart, sizeof(result.surfaceStart));
+        }
+    }
+    else if (count)
+    {
+        evaluateHarmonograph(request.params, request.step, count, result.curve.data());
+    }
+
+    result.id = request.id;
+    result.animationTime = request.animationTime;
+    result.renderSurface = request.renderSurface;
+    result.buildSeconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
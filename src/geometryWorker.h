@@ -0,0 +1,174 @@
+#ifndef GEOMETRYWORKER_H
+#define GEOMETRYWORKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frameArena.h"
+#include "geometry.h"
+
+#define GEOMETRY_QUEUE_SIZE 16 // requests in flight to the worker; it only builds the newest
+
+/******************************************************************************/
+/*******************************   Lock-free Handoff **************************/
+/******************************************************************************/
+
+// Bounded queue between exactly one producer thread and one consumer thread. Neither side locks or
+// waits: push fails when the queue is full and pop when it is empty.
+template <typename T, size_t N>
+class SpscQueue
+{
+public:
+    SpscQueue() : head(0), tail(0) {}
+
+    bool push(const T &item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N)
+        {
+            return false;
+        }
+        items[h % N] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = items[t % N];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire); }
+
+private:
+    T items[N];
+    std::atomic<size_t> head, tail; // head: next slot the producer writes; tail: next slot the consumer reads
+};
+
+// Three slots shared by one writer and one reader. The writer fills its back slot and publishes it;
+// the reader takes the newest published slot as its front. Neither side ever waits for the other,
+// and a slot the reader holds is never written.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : back(0), front(1), middle(2) {}
+
+    T &writeSlot() { return slots[back]; }
+    // Swap the back slot with the middle one and mark it fresh
+    void publish() { back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & SLOT; }
+
+    // The newest slot the writer published, or the one taken before when nothing new arrived
+    T &readSlot(bool &fresh)
+    {
+        fresh = (middle.load(std::memory_order_relaxed) & FRESH) != 0;
+        if (fresh)
+        {
+            front = middle.exchange(front, std::memory_order_acq_rel) & SLOT;
+        }
+        return slots[front];
+    }
+
+    // A published slot is waiting for the reader
+    bool hasFresh() const { return (middle.load(std::memory_order_acquire) & FRESH) != 0; }
+
+private:
+    enum
+    {
+        SLOT = 3,
+        FRESH = 4
+    };
+
+    T slots[3];
+    int back;               // writer only
+    int front;              // reader only
+    std::atomic<int> middle; // slot index, plus FRESH until the reader takes it
+};
+
+/******************************************************************************/
+/*******************************   Geometry Worker ****************************/
+/******************************************************************************/
+
+// What a frame wants drawn
+struct GeometryRequest
+{
+    uint64_t id;
+    HarmonographParams params;
+    float animationTime;
+    float step;
+    bool renderSurface;
+};
+
+// Vertex data of one request, ready to be copied into the vertex buffers
+struct GeometryResult
+{
+    uint64_t id; // of the request; 0 for a slot that was never written
+    float animationTime;
+    bool renderSurface;
+    std::vector<glm::vec3> curve;
+    std::vector<glm::vec3> mesh; // interleaved position and normal per strip index; empty without surface
+    size_t surfaceStart[SURFACE_COUNT + 1];
+    float buildSeconds;
+
+    GeometryResult() : id(0), animationTime(0.0f), renderSurface(false), surfaceStart(), buildSeconds(0.0f) {}
+};
+
+// Evaluates and extrudes curves on a thread of its own, so the render loop keeps its rate however long
+// a curve takes to build. The render thread sends requests and draws the newest finished result;
+// requests that pile up while the worker is busy are skipped in favour of the last one.
+class GeometryWorker
+{
+public:
+    GeometryWorker();
+    ~GeometryWorker();
+
+    // Ask for the geometry of a frame, sampled every step; repeats of the last request are ignored.
+    // Returns false when the queue is full, in which case the caller asks again next frame.
+    bool request(const HarmonographParams &params, float animationTime, float step, bool renderSurface);
+
+    // The newest finished result, or nullptr before the first one. It stays valid and unchanged until
+    // the next call.
+    const GeometryResult *newest();
+
+    // A request has not been drawn yet
+    bool isBusy() const { return completed.load(std::memory_order_acquire) != submitted || results.hasFresh(); }
+
+    // Stop the thread after the build it is running
+    void shutdown();
+
+private:
+    GeometryWorker(const GeometryWorker &);
+    GeometryWorker &operator=(const GeometryWorker &);
+
+    void run();
+    void build(const GeometryRequest &request, GeometryResult &result);
+
+    SpscQueue<GeometryRequest, GEOMETRY_QUEUE_SIZE> queue;
+    TripleBuffer<GeometryResult> results;
+    GeometryRequest last; // render thread
+    uint64_t submitted;   // render thread
+    std::atomic<uint64_t> completed;
+    bool hasResult;       // render thread
+
+    std::thread thread;
+    std::mutex mutex; // only for sleeping and waking the worker
+    std::condition_variable wake;
+    bool stopping;
+    FrameArena arena; // worker
+};
+
+#endif //GEOMETRYWORKER_H
@@ -0,0 +1,78 @@
+#include "gpuProfiler.h"
+
+#include <glad/glad.h>
+
+///=========================================================================================///
+///                                        GPU Profiler
+///=========================================================================================///
+
+GpuProfiler::GpuProfiler() : queries(), issued(), frames(), set(-1), active(-1), created(false)
+{
+}
+
+void GpuProfiler::create()
+{
+    glGenQueries(GPU_PROFILER_BUFFERS * PROFILE_STAGE_COUNT, &queries[0][0]);
+    created = true;
+}
+
+void GpuProfiler::destroy()
+{
+    if (created)
+    {
+        glDeleteQueries(GPU_PROFILER_BUFFERS * PROFILE_STAGE_COUNT, &queries[0][0]);
+        created = false;
+    }
+}
+
+void GpuProfiler::beginFrame()
+{
+    set = -1;
+    if (!created || !frameProfiler.profilesThisThread())
+    {
+        return;
+    }
+
+    uint64_t frame = frameProfiler.frameNumber();
+    set = frame % GPU_PROFILER_BUFFERS;
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+    {
+        if (!issued[set][s])
+        {
+            continue;
+        }
+        issued[set][s] = false;
+
+        GLint available = 0;
+        glGetQueryObjectiv(queries[set][s], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[set][s], GL_QUERY_RESULT, &elapsed);
+            frameProfiler.setGpuTime(frames[set], (ProfileStage)s, elapsed * 1e-9f);
+        }
+    }
+    frames[set] = frame;
+}
+
+bool GpuProfiler::begin(ProfileStage stage)
+{
+    if (set < 0 || active >= 0 || issued[set][stage])
+    {
+        return false;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[set][stage]);
+    active = stage;
+    return true;
+}
+
+void GpuProfiler::end()
+{
+    if (set < 0 || active < 0)
+    {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    issued[set][active] = true;
+    active = -1;
+}
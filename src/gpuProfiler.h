@@ -0,0 +1,68 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <cstdint>
+
+#include "profiler.h"
+
+#define GPU_PROFILER_BUFFERS 2 // query sets in flight; a set is read back when it comes round again
+
+/******************************************************************************/
+/********************************   GPU Profiler ******************************/
+/******************************************************************************/
+
+// GL_TIME_ELAPSED queries around stages of the frame, one set per frame in a ring of
+// GPU_PROFILER_BUFFERS sets. A set is read back just before it is reused, two frames after it was
+// issued, and only if its results are available, so reading never stalls the pipeline; results that
+// are not ready are dropped. Time elapsed queries cannot nest: a stage begun inside another is not
+// measured. Needs a current GL context.
+class GpuProfiler
+{
+public:
+    GpuProfiler();
+
+    void create();
+    void destroy();
+
+    // Read back the oldest set and start the set of the frame frameProfiler is in
+    void beginFrame();
+    // Returns whether the query started; only then call end
+    bool begin(ProfileStage stage);
+    void end();
+
+private:
+    GpuProfiler(const GpuProfiler &);
+    GpuProfiler &operator=(const GpuProfiler &);
+
+    unsigned int queries[GPU_PROFILER_BUFFERS][PROFILE_STAGE_COUNT];
+    bool issued[GPU_PROFILER_BUFFERS][PROFILE_STAGE_COUNT];
+    uint64_t frames[GPU_PROFILER_BUFFERS]; // frame each set was issued in
+    int set;                               // set of the current frame; -1 when the frame is not profiled
+    int active;                            // stage whose query is running, or -1
+    bool created;
+};
+
+// Times the GPU work issued in the rest of the enclosing block as stage
+class GpuProfileScope
+{
+public:
+    GpuProfileScope(GpuProfiler &profiler, ProfileStage stage) : profiler(profiler), started(profiler.begin(stage)) {}
+    ~GpuProfileScope()
+    {
+        if (started)
+        {
+            profiler.end();
+        }
+    }
+
+private:
+    GpuProfileScope(const GpuProfileScope &);
+    GpuProfileScope &operator=(const GpuProfileScope &);
+
+    GpuProfiler &profiler;
+    bool started;
+};
+
+#define GPU_PROFILE_SCOPE(profiler, stage) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(profiler, stage)
+
+#endif //GPUPROFILER_H
@@ -0,0 +1,140 @@
+#include "latencyControl.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include <glad/glad.h>
+
+#include "traceRecorder.h"
+
+///=========================================================================================///
+///                                       Latency Control
+///=========================================================================================///
+
+LatencyControl::LatencyControl()
+    : fences(), fenceCount(0), queueLimit(0), firstInput(0), workStart(0), lastSwap(0), averageWork(0.0), averageQueueWait(0.0), latencies(), samples(0)
+{
+}
+
+void LatencyControl::setQueuedFrames(int frames)
+{
+    queueLimit = std::min(std::max(frames, 0), LATENCY_MAX_QUEUED_FRAMES);
+}
+
+void LatencyControl::inputEvent()
+{
+    if (!firstInput)
+    {
+        firstInput = traceClock();
+    }
+}
+
+void LatencyControl::releaseFences(int keep)
+{
+    int drop = std::max(fenceCount - keep, 0);
+    for (int i = 0; i < drop; ++i)
+    {
+        glDeleteSync((GLsync)fences[i]);
+    }
+    for (int i = drop; i < fenceCount; ++i)
+    {
+        fences[i - drop] = fences[i];
+    }
+    fenceCount -= drop;
+}
+
+void LatencyControl::waitForQueue()
+{
+    if (queueLimit == 0)
+    {
+        releaseFences(0);
+        return;
+    }
+
+    TRACE_SCOPE("Queue wait");
+    uint64_t start = traceClock();
+    // The oldest fences finish first, so waiting on the one that must be done covers those before it
+    if (fenceCount >= queueLimit)
+    {
+        glClientWaitSync((GLsync)fences[fenceCount - queueLimit], GL_SYNC_FLUSH_COMMANDS_BIT, LATENCY_FENCE_TIMEOUT_NS);
+        releaseFences(queueLimit - 1);
+    }
+    averageQueueWait += LATENCY_SMOOTHING * ((traceClock() - start) * 1e-9 - averageQueueWait);
+}
+
+void LatencyControl::delayInput(double refreshSeconds)
+{
+    if (!lastSwap || refreshSeconds <= 0.0)
+    {
+        return;
+    }
+
+    // Start the frame just in time for the vsync after the last one
+    double sinceSwap = (traceClock() - lastSwap) * 1e-9;
+    double delay = std::min(refreshSeconds - averageWork - LATENCY_INPUT_MARGIN - sinceSwap, refreshSeconds);
+    if (delay > 0.0)
+    {
+        TRACE_SCOPE("Input delay");
+        std::this_thread::sleep_for(std::chrono::duration<double>(delay));
+    }
+}
+
+void LatencyControl::beginFrame()
+{
+    workStart = traceClock();
+}
+
+void LatencyControl::beforeSwap()
+{
+    if (workStart)
+    {
+        averageWork += LATENCY_SMOOTHING * ((traceClock() - workStart) * 1e-9 - averageWork);
+    }
+}
+
+void LatencyControl::frameSwapped()
+{
+    lastSwap = traceClock();
+    if (queueLimit > 0)
+    {
+        releaseFences(LATENCY_MAX_QUEUED_FRAMES - 1);
+        fences[fenceCount++] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    if (firstInput)
+    {
+        latencies[samples % LATENCY_HISTORY] = (float)((lastSwap - firstInput) * 1e-9);
+        ++samples;
+        firstInput = 0;
+    }
+}
+
+void LatencyControl::destroy()
+{
+    releaseFences(0);
+}
+
+double LatencyControl::percentile(double fraction) const
+{
+    size_t count = sampleCount();
+    if (count == 0)
+    {
+        return 0.0;
+    }
+    float sorted[LATENCY_HISTORY];
+    std::copy(latencies, latencies + count, sorted);
+    std::sort(sorted, sorted + count);
+    return sorted[std::min(count - 1, (size_t)(fraction * count))];
+}
+
+double LatencyControl::mean() const
+{
+    size_t count = sampleCount();
+    double total = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        total += latencies[i];
+    }
+    return count ? total / count : 0.0;
+}
@@ -0,0 +1,73 @@
+#ifndef LATENCYCONTROL_H
+#define LATENCYCONTROL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define LATENCY_HISTORY 256                 // input-to-swap samples kept for the statistics
+#define LATENCY_MAX_QUEUED_FRAMES 3         // most frames that can be left in flight on the GPU
+#define LATENCY_FENCE_TIMEOUT_NS 100000000  // longest wait for one frame, so a hung GPU cannot stall the loop
+#define LATENCY_INPUT_MARGIN 0.002          // seconds kept spare before the swap when input is sampled late
+#define LATENCY_SMOOTHING 0.1               // weight of the newest frame in the running averages
+
+/******************************************************************************/
+/*******************************   Latency Control ****************************/
+/******************************************************************************/
+
+// Keeps the time from input to the screen short. A fence after every swap bounds how many frames the
+// driver may queue ahead of the GPU, and input can be sampled as late before the next vsync as the
+// work of a frame allows. Input events are timestamped when GLFW delivers them, and the time from the
+// oldest one a frame shows to the end of its swap is measured.
+class LatencyControl
+{
+public:
+    LatencyControl();
+
+    // Most frames queued on the GPU, counting the one about to start; 0 leaves the queue to the driver
+    void setQueuedFrames(int frames);
+    int queuedFrames() const { return queueLimit; }
+
+    // Called by the input callbacks
+    void inputEvent();
+
+    // Block until fewer than queuedFrames() frames are unfinished on the GPU
+    void waitForQueue();
+    // Sleep until just long enough before the next vsync for a frame's work; refreshSeconds is the
+    // display refresh period
+    void delayInput(double refreshSeconds);
+
+    // Around the work of a frame: right before input is sampled, and right before and after the swap
+    void beginFrame();
+    void beforeSwap();
+    void frameSwapped();
+
+    // Delete the fences; needs the GL context
+    void destroy();
+
+    size_t sampleCount() const { return samples < LATENCY_HISTORY ? (size_t)samples : LATENCY_HISTORY; }
+    // Over the kept samples, in seconds; fraction 1 is the slowest
+    double percentile(double fraction) const;
+    double mean() const;
+    // Running averages, in seconds
+    double queueWait() const { return averageQueueWait; }
+    double frameWork() const { return averageWork; }
+
+private:
+    LatencyControl(const LatencyControl &);
+    LatencyControl &operator=(const LatencyControl &);
+
+    void releaseFences(int keep);
+
+    void *fences[LATENCY_MAX_QUEUED_FRAMES]; // GLsync of the newest frames, oldest first
+    int fenceCount;
+    int queueLimit;
+
+    uint64_t firstInput; // clock of the oldest input not shown yet; 0 when there is none
+    uint64_t workStart, lastSwap;
+    double averageWork, averageQueueWait;
+
+    float latencies[LATENCY_HISTORY];
+    uint64_t samples;
+};
+
+#endif //LATENCYCONTROL_H
@@ -5,12 +5,33 @@
 #include <list>
 #include <map>
 #include <numeric>
+#include <cmath>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shaderSource.h"
+#include "geometry.h"
+#include "meshExport.h"
+#include "exportWorker.h"
+#include "geometryWorker.h"
+#include "frameGovernor.h"
+#include "sceneTarget.h"
+#include "latencyControl.h"
+#include "curveCache.h"
+#include "curveCodec.h"
+#include "plotExport.h"
+#include "profiler.h"
+#include "gpuProfiler.h"
+#include "traceRecorder.h"
+#include "allocationTracker.h"
+#include "session.h"
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_glfw.h>
 
@@ -23,6 +44,12 @@ using namespace std;
 #define _Z_FAR 100.0f
 
 #define NUMBER_OF_VERTICES 10000 // Define the number of vertices
+#define REDRAW_SETTLE_FRAMES 3   // frames drawn after the last change, so ImGui can settle hover and release states
+#define IDLE_TIMEOUT 0.5         // seconds an idle loop sleeps before it looks at background work again
+#define IDLE_UPDATE_INTERVAL 0.1 // seconds between redraws while an export runs and nothing else changes
+#define IDLE_POLL_MS 10          // nap between event polls where GLFW cannot wait with a timeout
+#define TRACE_FILE "harmonograph_trace.json" // written by the Record trace checkbox
+#define SESSION_FILE "harmonograph_session.hgs" // written by the Record session checkbox
 
 /***********************************************************************/
 /**************************   global variables   ***********************/
@@ -35,6 +62,10 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
 void cursor_pos_callback(GLFWwindow *window, double xpos, double ypos);
+void char_callback(GLFWwindow *window, unsigned int codepoint);
+void cursor_enter_callback(GLFWwindow *window, int entered);
+void window_focus_callback(GLFWwindow *window, int focused);
+void window_refresh_callback(GLFWwindow *window);
 
 // Window size
 unsigned int winWidth = 1200;
@@ -47,6 +78,24 @@ glm::vec3 camera_up = glm::vec3(0.0f, 1.0f, 0.0f);
 float camera_fovy = 45.0f;
 glm::mat4 projection;
 
+// Render on demand: callbacks count input events, and the loop sleeps while nothing changes
+bool renderOnDemand = true;
+unsigned long inputEvents = 0;
+
+// Latency: frames queued on the GPU, input sampled late before the vsync, and the swap interval
+#define LATENCY_DEFAULT_QUEUED_FRAMES 2
+LatencyControl latencyControl;
+bool lateInput = false;
+enum VsyncMode
+{
+    VSYNC_OFF,
+    VSYNC_ON,
+    VSYNC_ADAPTIVE, // tears instead of waiting a whole refresh when a frame is late; needs EXT_swap_control_tear
+    VSYNC_MODE_COUNT
+};
+const char *vsyncModeNames[VSYNC_MODE_COUNT] = {"Off", "On", "Adaptive"};
+int vsyncMode = VSYNC_ON;
+
 // Mouse interaction
 bool leftMouseButtonHold = false;
 bool isFirstMouse = true;
@@ -83,6 +132,8 @@ glm::vec3 meshColorTable2[3] =
 // Animation Control
 bool isAnimating = true;
 bool isExported = false;
+ExportSettings exportSettings = {EXPORT_OBJ, true, OBJ_DEFAULT_PRECISION, false};
+PlotSettings plotSettings = {PLOT_GCODE, PLOT_DEFAULT_WIDTH, PLOT_DEFAULT_HEIGHT, PLOT_DEFAULT_MARGIN, PLOT_DEFAULT_TOLERANCE, PLOT_DEFAULT_FEED_RATE};
 float animationTime = 0.0f;
 
 // Parameters
@@ -96,8 +147,6 @@ float *dampPtr2 = new float[3];
 float *phasePtr1 = new float[3];
 float *phasePtr2 = new float[3];
 
-std::vector<float> vertices;
-
 ///=========================================================================================///
 ///                             Functions for Rendering 3D Model
 ///=========================================================================================///
@@ -285,6 +334,7 @@ void processInput(GLFWwindow *window)
 // ---------------------------------------------------------------------------------------------
 void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
+    ++inputEvents;
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
 
@@ -297,6 +347,8 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 // ---------------------------------------------------------
 void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
 {
+    ++inputEvents;
+    latencyControl.inputEvent();
     auto &io = ImGui::GetIO();
     if (io.WantCaptureMouse || io.WantCaptureKeyboard)
     {
@@ -316,6 +368,8 @@ void mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow *window, double xoffset, double yOffset)
 {
+    ++inputEvents;
+    latencyControl.inputEvent();
     float scale = 1.0f + _SCALE_FACTOR * yOffset;
 
     ScaleModel(scale);
@@ -325,6 +379,8 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yOffset)
 // ---------------------------------------------------------
 void cursor_pos_callback(GLFWwindow *window, double mouseX, double mouseY)
 {
+    ++inputEvents;
+    latencyControl.inputEvent();
     float dx, dy;
     float nx, ny, scale, angle;
 
@@ -383,439 +439,831 @@ void cursor_pos_callback(GLFWwindow *window, double mouseX, double mouseY)
 // ----------------------------------------------------------------------
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
+    ++inputEvents;
+    latencyControl.inputEvent();
     if (key == GLFW_KEY_C && action == GLFW_PRESS)
     {
         SetMeshColor();
     }
 }
 
+// glfw: text input, the cursor entering or leaving and focus changes only matter to ImGui, and a
+// refresh means the window contents were damaged; all of them need a redraw
+// ----------------------------------------------------------------------
+void char_callback(GLFWwindow *window, unsigned int codepoint)
+{
+    ++inputEvents;
+    latencyControl.inputEvent();
+}
+
+void cursor_enter_callback(GLFWwindow *window, int entered)
+{
+    ++inputEvents;
+}
+
+void window_focus_callback(GLFWwindow *window, int focused)
+{
+    ++inputEvents;
+}
+
+void window_refresh_callback(GLFWwindow *window)
+{
+    ++inputEvents;
+}
+
+///=========================================================================================///
+///                                     Render on Demand
+///=========================================================================================///
+
+// Everything the picture depends on besides ImGui, which wakes the loop through input events
+struct RedrawState
+{
+    HarmonographParams params;
+    float animationTime;
+    float step;
+    float sceneScale;
+    bool isAnimating;
+    glm::mat4 model;
+    unsigned int width, height;
+    int lightColor, meshColor1, meshColor2;
+};
+
+RedrawState currentRedrawState(const HarmonographParams &params, float animationTime, float step, float sceneScale)
+{
+    RedrawState state = {params, animationTime, step, sceneScale, isAnimating, modelMatrix, winWidth, winHeight, lightColorID, meshColorID1, meshColorID2};
+    return state;
+}
+
+bool sameRedrawState(const RedrawState &a, const RedrawState &b)
+{
+    return memcmp(&a.params, &b.params, sizeof(a.params)) == 0 && a.animationTime == b.animationTime && a.step == b.step && a.sceneScale == b.sceneScale && a.isAnimating == b.isAnimating &&
+           a.model == b.model && a.width == b.width && a.height == b.height && a.lightColor == b.lightColor && a.meshColor1 == b.meshColor1 &&
+           a.meshColor2 == b.meshColor2;
+}
+
+// Sleep until an input event arrives, the window is asked to close or timeout seconds have passed
+void waitForInput(GLFWwindow *window, double timeout)
+{
+#if GLFW_VERSION_MAJOR > 3 || (GLFW_VERSION_MAJOR == 3 && GLFW_VERSION_MINOR >= 2)
+    glfwWaitEventsTimeout(timeout);
+#else
+    // GLFW before 3.2 cannot wait with a timeout, so poll with short naps in between
+    unsigned long seen = inputEvents;
+    double end = glfwGetTime() + timeout;
+    glfwPollEvents();
+    while (inputEvents == seen && !glfwWindowShouldClose(window) && glfwGetTime() < end)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_POLL_MS));
+        glfwPollEvents();
+    }
+#endif
+}
+
+///=========================================================================================///
+///                             Helper Functions for VBO
+///=========================================================================================///
+
+// Persistent buffers for the curve and the extruded mesh; their storage only grows
+struct GeometryBuffers
+{
+    unsigned int curveVAO, curveVBO;
+    unsigned int meshVAO, meshVBO;
+    size_t curveCapacity, meshCapacity;
+    size_t cachedSamples; // samples last copied from the curve cache; 0 once the buffers hold anything else
+    uint64_t workerResult; // id of the geometry worker result the buffers hold; 0 once they hold anything else
+};
+
+GeometryBuffers geometryBuffers;
+
+void createGeometryBuffers(GeometryBuffers &buffers)
+{
+    glGenVertexArrays(1, &buffers.curveVAO);
+    glGenBuffers(1, &buffers.curveVBO);
+    glBindVertexArray(buffers.curveVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.curveVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    // extruded mesh is interleaved: position, normal
+    glGenVertexArrays(1, &buffers.meshVAO);
+    glGenBuffers(1, &buffers.meshVBO);
+    glBindVertexArray(buffers.meshVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.meshVBO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void *)sizeof(glm::vec3));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    buffers.curveCapacity = 0;
+    buffers.meshCapacity = 0;
+    buffers.cachedSamples = 0;
+    buffers.workerResult = 0;
+}
+
+void deleteGeometryBuffers(GeometryBuffers &buffers)
+{
+    glDeleteVertexArrays(1, &buffers.curveVAO);
+    glDeleteBuffers(1, &buffers.curveVBO);
+    glDeleteVertexArrays(1, &buffers.meshVAO);
+    glDeleteBuffers(1, &buffers.meshVBO);
+}
+
+// Map size bytes of a vertex buffer for writing. The previous contents are invalidated so the
+// driver can hand out fresh memory instead of waiting for draws that still read the old data.
+void *mapVertexBuffer(unsigned int buffer, size_t &capacity, size_t size)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if (size > capacity)
+    {
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        capacity = size;
+    }
+    return glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
 ///=========================================================================================///
-///                          Vertex Normals + Surfaces + Extrusions
+///                                      Harmonograph Function
 ///=========================================================================================///
 
-// Function to calculate normals for each vertex
-std::vector<glm::vec3> calculateNormals(const std::vector<float> &vertices)
+// Snapshot of the parameters edited in the UI
+HarmonographParams currentParams()
+{
+    HarmonographParams params;
+    params.amplitude = amplitude;
+    for (int i = 0; i < 3; ++i)
+    {
+        params.freq1[i] = freqPtr1[i];
+        params.freq2[i] = freqPtr2[i];
+        params.damp1[i] = dampPtr1[i];
+        params.damp2[i] = dampPtr2[i];
+        params.phase1[i] = phasePtr1[i];
+        params.phase2[i] = phasePtr2[i];
+    }
+    return params;
+}
+
+// Transient geometry of the current frame; reset at the start of every frame
+FrameArena frameArena;
+
+// Writes exports, plots and saved designs without blocking the render loop
+ExportWorker exportWorker;
+
+// Builds the geometry of the frames off the render thread while "Background geometry" is ticked
+GeometryWorker geometryWorker;
+bool backgroundGeometry = true;
+float geometryBuildSeconds = 0.0f; // of the result drawn last
+
+// Coarsens the curve sampling while frames run over budget
+FrameGovernor frameGovernor;
+
+// Draws the scene below window resolution while the GPU runs over budget
+SceneTarget sceneTarget;
+ResolutionGovernor resolutionGovernor;
+bool sharpenScene = true;
+AntiAliasing antiAliasing = AA_NONE;
+
+// GPU side of the frame profiler; the overlay shows both
+GpuProfiler gpuProfiler;
+bool showProfiler = false;
+
+// Inputs of every frame while "Record session" is ticked, for replay with --replay
+SessionRecorder sessionRecorder;
+
+// Design saved with "Save design"; mapped while it is open
+#define DESIGN_FILENAME "harmonograph_design.hgc"
+CurveCache curveCache;
+unsigned long designJob = 0; // export job writing the design, mapped once it succeeds; 0 when none is pending
+
+// Draw the curve straight from the mapped cache when it holds these parameters. The sections are
+// copied into the buffers once and drawn from there until the curve changes.
+bool drawCachedHarmonograph(const HarmonographParams &params, float animationTime, bool renderSurface)
 {
-    std::vector<glm::vec3> normals;
-    for (size_t i = 0; i < vertices.size(); i += 3)
+    size_t count = harmonographSampleCount(animationTime, HARMONOGRAPH_STEP);
+    if (!curveCache.matches(params, HARMONOGRAPH_STEP, animationTime) || (renderSurface && !curveCache.hasMesh(count)))
+    {
+        return false;
+    }
+
+    if (geometryBuffers.cachedSamples != count)
     {
-        // Calculate the direction from the current point to the next point
-        glm::vec3 currentPoint(vertices[i], vertices[i + 1], vertices[i + 2]);
-        glm::vec3 nextPoint;
-        if (i + 3 < vertices.size())
+        geometryBuffers.workerResult = 0;
+        PROFILE_SCOPE(PROFILE_UPLOAD);
+        GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_UPLOAD);
+        glBindBuffer(GL_ARRAY_BUFFER, geometryBuffers.curveVBO);
+        geometryBuffers.curveCapacity = count * sizeof(glm::vec3);
+        glBufferData(GL_ARRAY_BUFFER, geometryBuffers.curveCapacity, curveCache.positions(), GL_STATIC_DRAW);
+        if (curveCache.hasMesh(count))
         {
-            nextPoint = glm::vec3(vertices[i + 3], vertices[i + 4], vertices[i + 5]);
+            glBindBuffer(GL_ARRAY_BUFFER, geometryBuffers.meshVBO);
+            geometryBuffers.meshCapacity = curveCache.meshVertexCount() * 2 * sizeof(glm::vec3);
+            glBufferData(GL_ARRAY_BUFFER, geometryBuffers.meshCapacity, curveCache.meshVertices(), GL_STATIC_DRAW);
         }
-        else
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        geometryBuffers.cachedSamples = count;
+    }
+
+    PROFILE_SCOPE(PROFILE_DRAW);
+    GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_DRAW);
+    glBindVertexArray(geometryBuffers.curveVAO);
+    glDrawArrays(GL_LINE_STRIP, 0, count);
+    if (renderSurface)
+    {
+        const CurveCacheHeader &header = curveCache.header();
+        glBindVertexArray(geometryBuffers.meshVAO);
+        for (int s = 0; s < SURFACE_COUNT; ++s)
         {
-            // If it's the last point, use the previous point as the next point
-            nextPoint = glm::vec3(vertices[i - 3], vertices[i - 2], vertices[i - 1]);
+            glDrawArrays(GL_TRIANGLE_STRIP, header.surfaceStart[s], header.surfaceStart[s + 1] - header.surfaceStart[s]);
         }
-        glm::vec3 direction = nextPoint - currentPoint;
-        // Normalize the direction to get the normal
-        glm::vec3 normal = glm::normalize(direction);
-        normals.push_back(normal);
     }
-    return normals;
+    glBindVertexArray(0);
+    return true;
 }
 
-void calculateTriangleStripNormals(const std::vector<glm::vec3> &vertices, const std::vector<unsigned int> &indices, std::vector<glm::vec3> &normals, bool invertNormals = false)
+// Ask the geometry worker for this frame's curve and draw the newest one it has finished, which may be
+// a few frames old while a long curve builds. The buffers are only written when a new result arrives.
+void drawWorkerHarmonograph(const HarmonographParams &params, float animationTime, float step, bool renderSurface)
 {
-    normals.clear();
-    normals.resize(vertices.size(), glm::vec3(0.0f));
-
-    // Calculate normals for each triangle in the triangle strip
-    for (size_t i = 0; i < indices.size() - 2; ++i)
+    geometryWorker.request(params, animationTime, step, renderSurface);
+    const GeometryResult *result = geometryWorker.newest();
+    if (!result || result->curve.empty())
     {
-        const glm::vec3 &v0 = vertices[indices[i]];
-        const glm::vec3 &v1 = vertices[indices[i + 1]];
-        const glm::vec3 &v2 = vertices[indices[i + 2]];
+        return;
+    }
 
-        glm::vec3 edge1 = v1 - v0;
-        glm::vec3 edge2 = v2 - v0;
-        glm::vec3 triangleNormal = glm::cross(edge1, edge2);
+    bool meshUploaded = !result->mesh.empty();
+    if (geometryBuffers.workerResult != result->id)
+    {
+        PROFILE_SCOPE(PROFILE_UPLOAD);
+        GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_UPLOAD);
+        size_t curveBytes = result->curve.size() * sizeof(glm::vec3);
+        void *curve = mapVertexBuffer(geometryBuffers.curveVBO, geometryBuffers.curveCapacity, curveBytes);
+        bool curveUploaded = curve != nullptr;
+        if (curve)
+        {
+            memcpy(curve, result->curve.data(), curveBytes);
+            curveUploaded = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+        }
+        if (meshUploaded)
+        {
+            size_t meshBytes = result->mesh.size() * sizeof(glm::vec3);
+            void *mesh = mapVertexBuffer(geometryBuffers.meshVBO, geometryBuffers.meshCapacity, meshBytes);
+            meshUploaded = mesh != nullptr;
+            if (mesh)
+            {
+                memcpy(mesh, result->mesh.data(), meshBytes);
+                meshUploaded = glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE;
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        geometryBuildSeconds = result->buildSeconds;
+        // A failed upload is tried again next frame
+        bool uploaded = curveUploaded && (meshUploaded || result->mesh.empty());
+        geometryBuffers.workerResult = uploaded ? result->id : 0;
+        if (!geometryBuffers.workerResult)
+        {
+            return;
+        }
+    }
 
-        // Ensure correct winding order by flipping normals if necessary
-        if (glm::dot(triangleNormal, normals[indices[i]]) < 0.0f)
+    PROFILE_SCOPE(PROFILE_DRAW);
+    GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_DRAW);
+    glBindVertexArray(geometryBuffers.curveVAO);
+    glDrawArrays(GL_LINE_STRIP, 0, result->curve.size());
+    if (meshUploaded && renderSurface)
+    {
+        glBindVertexArray(geometryBuffers.meshVAO);
+        for (int s = 0; s < SURFACE_COUNT; ++s)
         {
-            triangleNormal = -triangleNormal;
+            glDrawArrays(GL_TRIANGLE_STRIP, result->surfaceStart[s], result->surfaceStart[s + 1] - result->surfaceStart[s]);
         }
+    }
+    glBindVertexArray(0);
+}
+
+void drawHarmonograph(float animationTime, bool renderSurface)
+{
+    HarmonographParams params = currentParams();
+    // The frame governor only coarsens what is drawn; exports keep every sample
+    // An Export press only runs once the surface is drawn; until then the frame is drawn as any other
+    bool exporting = isExported && renderSurface;
+    float step = exporting ? HARMONOGRAPH_STEP : frameGovernor.step();
+    size_t count = harmonographSampleCount(animationTime, step);
+    if (count == 0)
+    {
+        return;
+    }
 
-        normals[indices[i]] += triangleNormal;
-        normals[indices[i + 1]] += triangleNormal;
-        normals[indices[i + 2]] += triangleNormal;
+    // An export needs the mesh itself, so it always builds here
+    if (!exporting && drawCachedHarmonograph(params, animationTime, renderSurface))
+    {
+        return;
     }
+    geometryBuffers.cachedSamples = 0;
+    if (!exporting && backgroundGeometry)
+    {
+        drawWorkerHarmonograph(params, animationTime, step, renderSurface);
+        return;
+    }
+    geometryBuffers.workerResult = 0;
 
-    // Normalize the accumulated normals
-    for (auto &normal : normals)
+    // A mesh that is about to be exported lives on the heap, so it can be handed to the export thread
+    ExtrudedMesh extrudedMesh(exporting ? nullptr : &frameArena);
+    if (renderSurface) // if user clicks extrude
     {
-        if (glm::length(normal) > 0.0f)
+        // Evaluate, ribbon and extrude the curve in one pass
+        buildExtrudedMesh(params, animationTime, step, extrudedMesh);
+    }
+
+    // Write the curve straight into the vertex buffer; without extrusion the evaluator writes there directly.
+    // Both buffers are written before anything is drawn, so the stages can be timed apart.
+    size_t curveBytes = count * sizeof(glm::vec3);
+    bool drawSurface = renderSurface && !extrudedMesh.indices.empty();
+    bool curveMapped = false, meshMapped = false;
+    {
+        PROFILE_SCOPE(PROFILE_UPLOAD);
+        GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_UPLOAD);
+        glm::vec3 *curve = (glm::vec3 *)mapVertexBuffer(geometryBuffers.curveVBO, geometryBuffers.curveCapacity, curveBytes);
+        if (curve)
         {
-            normal = glm::normalize(normal);
+            if (renderSurface)
+            {
+                memcpy(curve, extrudedMesh.curve.data(), curveBytes);
+            }
+            else
+            {
+                evaluateHarmonograph(params, step, count, curve);
+            }
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            curveMapped = true;
         }
 
-        // Invert when necessary
-        if (invertNormals)
+        // -- to see the tangents the surface is built from, draw extrudedMesh.ribbon as GL_LINES
+
+        // Write the final interleaved vertices of all six strips into the mesh buffer
+        if (drawSurface)
         {
-            normal = -normal;
+            size_t meshBytes = extrudedMesh.indices.size() * 2 * sizeof(glm::vec3);
+            glm::vec3 *meshVertices = (glm::vec3 *)mapVertexBuffer(geometryBuffers.meshVBO, geometryBuffers.meshCapacity, meshBytes);
+            if (meshVertices)
+            {
+                interleaveExtrudedMesh(extrudedMesh, meshVertices);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+                meshMapped = true;
+            }
         }
     }
-}
 
-void extrudeSurface(const std::vector<glm::vec3> &surfaceVertices, std::vector<glm::vec3> &surfaceNormals, float extrusionDistance, std::vector<glm::vec3> &extrudedVertices, std::vector<unsigned int> &topSurfaceIndices, std::vector<unsigned int> &bottomSurfaceIndices, std::vector<unsigned int> &frontSurfaceIndices, std::vector<unsigned int> &endSurfaceIndices, std::vector<unsigned int> &sideSurface1Indices, std::vector<unsigned int> &sideSurface2Indices)
-{
-    size_t numVertices = surfaceVertices.size();
-    size_t numExtrudedVertices = 2 * numVertices;
+    {
+        PROFILE_SCOPE(PROFILE_DRAW);
+        GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_DRAW);
+        // Draw line segments
+        if (curveMapped)
+        {
+            glBindVertexArray(geometryBuffers.curveVAO);
+            glDrawArrays(GL_LINE_STRIP, 0, count);
+        }
 
-    extrudedVertices.reserve(numExtrudedVertices);
+        // Draw each surface
+        if (meshMapped)
+        {
+            glBindVertexArray(geometryBuffers.meshVAO);
+            for (int s = 0; s < SURFACE_COUNT; ++s)
+            {
+                glDrawArrays(GL_TRIANGLE_STRIP, extrudedMesh.surfaceStart[s], extrudedMesh.surfaceSize(s));
+            }
+        }
+    }
 
-    // Create vertices for the top surface of the extrusion
-    for (size_t i = 0; i < numVertices; ++i)
+    if (drawSurface && exporting)
     {
-        // Extrude each vertex along its normal direction
-        glm::vec3 extrudedVertex = surfaceVertices[i] + extrusionDistance * surfaceNormals[i];
-        extrudedVertices.push_back(extrudedVertex);
+        exportWorker.submit(std::move(extrudedMesh), exportSettings, std::string("harmonograph_object.") + exportFormatExtensions[exportSettings.format]);
+        isExported = false;
     }
 
-    // Create vertices for the bottom surface of the extrusion
-    for (size_t i = 0; i < numVertices; ++i)
+    // Clean up
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+// Hand the times of the frame that just ended to the governor. It is held while a session records,
+// since the log keeps a single curve step.
+void updateFrameGovernor()
+{
+    if (!frameGovernor.isEnabled() || !frameProfiler.frameCount() || sessionRecorder.isRecording())
     {
-        // Bottom surface vertices are the same as the original surface vertices but at a lower position
-        glm::vec3 bottomVertex = surfaceVertices[i];
-        extrudedVertices.push_back(bottomVertex);
+        return;
     }
 
-    for (size_t i = 0; i < numVertices; ++i)
+    const ProfileFrame &frame = frameProfiler.frame(0);
+    float geometry = 0.0f, other = 0.0f;
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
     {
-        topSurfaceIndices.push_back(i);
+        if (s >= PROFILE_EVALUATE && s <= PROFILE_DRAW)
+        {
+            geometry += frame.cpu[s];
+        }
+        else if (s != PROFILE_SWAP)
+        {
+            other += frame.cpu[s];
+        }
     }
 
-    for (size_t i = 0; i < numVertices; ++i)
+    // A curve the worker takes longer than a frame to build lags behind the frame rate
+    if (backgroundGeometry)
     {
-        bottomSurfaceIndices.push_back(numVertices + i);
+        geometry = std::max(geometry, geometryBuildSeconds);
     }
 
-    // create indices for front + end surface
-    frontSurfaceIndices.push_back(0);
-    frontSurfaceIndices.push_back(numVertices);
-    frontSurfaceIndices.push_back(1);
-    frontSurfaceIndices.push_back(numVertices + 1);
+    // The GPU may be the slower side; its times arrive a few frames late
+    for (size_t age = 0; age < frameProfiler.frameCount() && age <= GPU_PROFILER_BUFFERS; ++age)
+    {
+        const ProfileFrame &gpuFrame = frameProfiler.frame(age);
+        if (gpuFrame.gpu[PROFILE_DRAW] >= 0.0f)
+        {
+            geometry = std::max(geometry, std::max(gpuFrame.gpu[PROFILE_UPLOAD], 0.0f) + gpuFrame.gpu[PROFILE_DRAW]);
+            break;
+        }
+    }
 
-    endSurfaceIndices.push_back(numVertices - 1);
-    endSurfaceIndices.push_back(2 * (numVertices)-1);
-    endSurfaceIndices.push_back(numVertices - 2);
-    endSurfaceIndices.push_back(2 * (numVertices)-2);
+    frameGovernor.update(geometry, other);
+}
 
-    // create indices for side faces
-    for (size_t i = 0; i < numVertices; i += 2)
+// Hand the GPU times of the newest frame that has them to the resolution governor
+void updateResolutionGovernor()
+{
+    if (!resolutionGovernor.isEnabled())
     {
-        sideSurface1Indices.push_back(i);
-        sideSurface1Indices.push_back(i + numVertices);
+        return;
     }
-    for (size_t i = 1; i < numVertices; i += 2)
+
+    for (size_t age = 0; age < frameProfiler.frameCount() && age <= GPU_PROFILER_BUFFERS; ++age)
     {
-        sideSurface2Indices.push_back(i);
-        sideSurface2Indices.push_back(i + numVertices);
+        const ProfileFrame &frame = frameProfiler.frame(age);
+        if (frame.gpu[PROFILE_DRAW] < 0.0f)
+        {
+            continue;
+        }
+        float other = 0.0f;
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            if (s != PROFILE_DRAW)
+            {
+                other += std::max(frame.gpu[s], 0.0f);
+            }
+        }
+        resolutionGovernor.update(frame.gpu[PROFILE_DRAW], other, frameGovernor.target());
+        return;
     }
 }
 
 ///=========================================================================================///
-///                                       Export OBJ
+///                                     Profiler Overlay
 ///=========================================================================================///
 
-void exportToObj(const std::vector<glm::vec3> &extrudedVertices, const std::string &filename, std::vector<glm::vec3> allNormals, int startingIndices[],
-                 std::vector<unsigned int> &topSurfaceIndices, std::vector<unsigned int> &bottomSurfaceIndices, std::vector<unsigned int> &frontSurfaceIndices, std::vector<unsigned int> &endSurfaceIndices, std::vector<unsigned int> &sideSurface1Indices, std::vector<unsigned int> &sideSurface2Indices)
-{
+#define PROFILER_GRAPH_HEIGHT 120.0f     // stacked frame graph, in pixels
+#define PROFILER_HISTOGRAM_BUCKETS 50
+#define PROFILER_HISTOGRAM_BUCKET_MS 0.5f // the last bucket also holds every slower frame
 
-    size_t numVertices = extrudedVertices.size() / 2;
+const ImU32 profileStageColors[PROFILE_STAGE_COUNT] = {IM_COL32(220, 120, 170, 255), IM_COL32(230, 85, 70, 255), IM_COL32(240, 160, 60, 255),
+                                                       IM_COL32(230, 215, 80, 255), IM_COL32(120, 200, 90, 255), IM_COL32(70, 170, 220, 255),
+                                                       IM_COL32(60, 200, 180, 255), IM_COL32(150, 110, 220, 255), IM_COL32(120, 120, 120, 255),
+                                                       IM_COL32(70, 70, 70, 255)};
 
-    std::ofstream outputFile(filename);
-    if (!outputFile.is_open())
+// Mean CPU and GPU time per stage, CPU time of every stage stacked frame by frame, and histograms of
+// the CPU and GPU frame times over the history of the profiler
+void drawProfilerWindow(bool *open)
+{
+    ImGui::SetNextWindowSize(ImVec2(480.0f, 460.0f), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Profiler", open))
     {
-        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        ImGui::End();
         return;
     }
-
-    // iterate over vertices
-    for (const auto &vertex : extrudedVertices)
+    size_t count = frameProfiler.frameCount();
+    if (count == 0)
     {
-        outputFile << "v " << vertex.x << " " << vertex.y << " " << vertex.z << "\n";
+        ImGui::Text("Collecting frames...");
+        ImGui::End();
+        return;
     }
 
-    // iterate over normals
-    for (const auto &normal : allNormals)
+    // GPU means only cover the frames whose queries came back
+    float cpu[PROFILE_STAGE_COUNT] = {}, gpu[PROFILE_STAGE_COUNT] = {};
+    int gpuFrames[PROFILE_STAGE_COUNT] = {};
+    float frameMean = 0.0f, frameWorst = 0.0f;
+    float cpuBuckets[PROFILER_HISTOGRAM_BUCKETS] = {}, gpuBuckets[PROFILER_HISTOGRAM_BUCKETS] = {};
+    for (size_t age = 0; age < count; ++age)
+    {
+        const ProfileFrame &frame = frameProfiler.frame(age);
+        frameMean += frame.frameTime;
+        frameWorst = std::max(frameWorst, frame.frameTime);
+        float gpuTotal = -1.0f;
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            cpu[s] += frame.cpu[s];
+            if (frame.gpu[s] >= 0.0f)
+            {
+                gpu[s] += frame.gpu[s];
+                ++gpuFrames[s];
+                gpuTotal = std::max(gpuTotal, 0.0f) + frame.gpu[s];
+            }
+        }
+        cpuBuckets[std::min(PROFILER_HISTOGRAM_BUCKETS - 1, (int)(1e3f * frame.frameTime / PROFILER_HISTOGRAM_BUCKET_MS))] += 1.0f;
+        if (gpuTotal >= 0.0f)
+        {
+            gpuBuckets[std::min(PROFILER_HISTOGRAM_BUCKETS - 1, (int)(1e3f * gpuTotal / PROFILER_HISTOGRAM_BUCKET_MS))] += 1.0f;
+        }
+    }
+    frameMean /= count;
+    ImGui::Text("%.2f ms per frame (%.0f fps), worst %.2f ms, over %zu frames", 1e3f * frameMean, 1.0f / frameMean, 1e3f * frameWorst, count);
+    // Multisampling costs in Draw, its resolve and FXAA in Post
+    ImGui::Text("Anti-aliasing: %s, scene at %.0f%%", antiAliasingNames[antiAliasing], 100.0f * resolutionGovernor.scale());
+
+    // Allocations per frame over the history of the allocation tracker, in allocation-tracking builds
+    size_t heapFrames = allocationTracker.frameCount();
+    float allocations[PROFILE_STAGE_COUNT] = {};
+    for (size_t age = 0; age < heapFrames; ++age)
     {
-        outputFile << "vn " << normal.x << " " << normal.y << " " << normal.z << "\n";
+        const AllocationFrame &frame = allocationTracker.frame(age);
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            allocations[s] += (float)frame.allocations[s] / heapFrames;
+        }
     }
 
-    auto exportFaces = [&outputFile](const std::vector<unsigned int> &surfaceIndices, int start)
+    if (ImGui::BeginTable("Stages", heapFrames ? 4 : 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
     {
-        // Iterate through each triangle strip
-        for (int i = 0; i < surfaceIndices.size() - 2; ++i)
+        ImGui::TableSetupColumn("Stage");
+        ImGui::TableSetupColumn("CPU ms");
+        ImGui::TableSetupColumn("GPU ms");
+        if (heapFrames)
         {
-            int v1, v2, v3;
-            int vn1, vn2, vn3;
-            if (i % 2 == 0) // this accounts for winding order
+            ImGui::TableSetupColumn("Allocs");
+        }
+        ImGui::TableHeadersRow();
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::ColorButton(profileStageNames[s], ImGui::ColorConvertU32ToFloat4(profileStageColors[s]), ImGuiColorEditFlags_NoTooltip, ImVec2(10.0f, 10.0f));
+            ImGui::SameLine();
+            ImGui::Text("%s", profileStageNames[s]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", 1e3f * cpu[s] / count);
+            ImGui::TableNextColumn();
+            if (gpuFrames[s])
             {
-                v1 = surfaceIndices[i] + 1;
-                v2 = surfaceIndices[i + 1] + 1;
-                v3 = surfaceIndices[i + 2] + 1;
-
-                // determine normal indices for current face
-                vn1 = start + i + 1;
-                vn2 = start + i + 2;
-                vn3 = start + i + 3;
+                ImGui::Text("%.3f", 1e3f * gpu[s] / gpuFrames[s]);
             }
             else
             {
-                v1 = surfaceIndices[i + 2] + 1;
-                v2 = surfaceIndices[i + 1] + 1;
-                v3 = surfaceIndices[i] + 1;
-
-                // determine normal indices for current face
-                vn1 = start + i + 3;
-                vn2 = start + i + 2;
-                vn3 = start + i + 1;
+                ImGui::TextDisabled("-");
+            }
+            if (heapFrames)
+            {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", allocations[s]);
             }
-
-            // Export face with vertex indices
-            outputFile << "f " << v1 << "//" << vn1 << " " << v2 << "//" << vn2 << " " << v3 << "//" << vn3 << "\n";
         }
-    };
-
-    exportFaces(topSurfaceIndices, startingIndices[0]);
-    exportFaces(bottomSurfaceIndices, startingIndices[1]);
-    exportFaces(frontSurfaceIndices, startingIndices[2]);
-    exportFaces(endSurfaceIndices, startingIndices[3]);
-    exportFaces(sideSurface1Indices, startingIndices[4]);
-    exportFaces(sideSurface2Indices, startingIndices[5]);
+        ImGui::EndTable();
+    }
 
-    outputFile.close();
+    // One column per frame, newest on the right, scaled to the worst frame; the line marks 60 fps
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = ImGui::GetContentRegionAvail().x;
+    float scale = PROFILER_GRAPH_HEIGHT / std::max(frameWorst, 1.0f / 60.0f);
+    float columnWidth = width / PROFILER_HISTORY;
+    float bottom = origin.y + PROFILER_GRAPH_HEIGHT;
+    drawList->AddRectFilled(origin, ImVec2(origin.x + width, bottom), IM_COL32(25, 25, 25, 255));
+    for (size_t age = 0; age < count; ++age)
+    {
+        const ProfileFrame &frame = frameProfiler.frame(age);
+        float right = origin.x + width - age * columnWidth;
+        float y = bottom;
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            float height = frame.cpu[s] * scale;
+            drawList->AddRectFilled(ImVec2(right - columnWidth, y - height), ImVec2(right, y), profileStageColors[s]);
+            y -= height;
+        }
+    }
+    float target = bottom - scale / 60.0f;
+    drawList->AddLine(ImVec2(origin.x, target), ImVec2(origin.x + width, target), IM_COL32(255, 255, 255, 160));
+    ImGui::Dummy(ImVec2(width, PROFILER_GRAPH_HEIGHT));
+
+    char label[64];
+    snprintf(label, sizeof(label), "CPU frame time, 0-%.0f ms", PROFILER_HISTOGRAM_BUCKETS * PROFILER_HISTOGRAM_BUCKET_MS);
+    ImGui::PlotHistogram("##CpuFrames", cpuBuckets, PROFILER_HISTOGRAM_BUCKETS, 0, label, 0.0f, FLT_MAX, ImVec2(width, 60.0f));
+    snprintf(label, sizeof(label), "GPU frame time, 0-%.0f ms", PROFILER_HISTOGRAM_BUCKETS * PROFILER_HISTOGRAM_BUCKET_MS);
+    ImGui::PlotHistogram("##GpuFrames", gpuBuckets, PROFILER_HISTOGRAM_BUCKETS, 0, label, 0.0f, FLT_MAX, ImVec2(width, 60.0f));
+    ImGui::End();
 }
 
 ///=========================================================================================///
-///                             Helper Functions for VBO
+///                                      Headless Export
 ///=========================================================================================///
 
-void generateAndBindIndexVBO(unsigned int &indexVBO, const std::vector<unsigned int> &indices)
-{
-    glGenBuffers(1, &indexVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-}
+#define HEADLESS_DEFAULT_TIME 100.0f // animation time exported when --time is not given
 
-// Function to generate and bind a VBO for normals
-void generateAndBindNormalVBO(unsigned int &normalVBO, const std::vector<glm::vec3> &normals)
+void printUsage(const char *program)
 {
-    glGenBuffers(1, &normalVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
-    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), normals.data(), GL_STATIC_DRAW);
-    glEnableVertexAttribArray(1); // Assuming the attribute location for normals is 1
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
+    std::cerr << "Usage: " << program << " --export FILE [options]\n"
+              << "       " << program << " --replay FILE." << SESSION_EXTENSION << " [--checksums]\n"
+              << "Streams the extruded curve to FILE without opening a window, plots the curve\n"
+              << "as G-code or SVG, or stores its samples compressed (hgz).\n"
+              << "  --format obj|stl|ply|glb|gcode|svg|hgz  file format (default: from the file extension)\n"
+              << "  --preset 1|2|3            pendulum preset of the UI (default: 1)\n"
+              << "  --time T                  animation time the curve is drawn to (default: " << HEADLESS_DEFAULT_TIME << ")\n"
+              << "  --step S                  time between two curve samples (default: " << HARMONOGRAPH_STEP << ")\n"
+              << "  --precision N             OBJ decimals, 1-9 (default: " << OBJ_DEFAULT_PRECISION << ")\n"
+              << "  --quantize                GLB: 16-bit positions and 8-bit normals\n"
+              << "  --tolerance D             G-code/SVG: mm the path may deviate when simplifying (default: " << PLOT_DEFAULT_TOLERANCE << ")\n"
+              << "                            hgz: largest error of a stored coordinate (default: " << CURVE_CODEC_DEFAULT_TOLERANCE << ")\n"
+              << "  --replay FILE             run the frames of a recorded session and print their timings\n"
+              << "  --checksums               replay: print a hash of the geometry of every frame\n";
 }
 
-// Draw surface using indices and normals VBOs
-void drawSurface(unsigned int indexVBO, unsigned int normalVBO, const std::vector<unsigned int> &indices, GLsizei count)
-{
-    glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexVBO);
-    glDrawElements(GL_TRIANGLE_STRIP, count, GL_UNSIGNED_INT, 0);
-}
+#define HEADLESS_CURVE_FORMAT (EXPORT_FORMAT_COUNT + PLOT_FORMAT_COUNT)
 
-///=========================================================================================///
-///                                      Harmonograph Function
-///=========================================================================================///
-
-void drawHarmonograph(float animationTime, bool renderSurface)
+// Mesh formats, then plot formats (format - EXPORT_FORMAT_COUNT), then HEADLESS_CURVE_FORMAT
+bool parseFormat(const std::string &name, int &format)
 {
-    // Buffers for harmonograph line segments
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-    // Draw the harmonograph
-    std::vector<float> vertices;
-    float x, y, z, time;
-
-    for (time = 0; time < animationTime; time += 0.01)
+    for (int f = 0; f < EXPORT_FORMAT_COUNT; ++f)
     {
-        x = amplitude * sin(time * freqPtr1[0] + phasePtr1[0]) * exp(-dampPtr1[0] * time) + amplitude * sin(time * freqPtr1[1] + phasePtr1[1]) * exp(-dampPtr1[1] * time);
-        y = amplitude * sin(time * freqPtr1[2] + phasePtr1[2]) * exp(-dampPtr1[2] * time) + amplitude * sin(time * freqPtr2[0] + phasePtr2[0]) * exp(-dampPtr2[0] * time);
-        z = amplitude * sin(time * freqPtr2[1] + phasePtr2[1]) * exp(-dampPtr2[1] * time) + amplitude * sin(time * freqPtr2[2] + phasePtr1[2]) * exp(-dampPtr2[2] * time);
-
-        vertices.push_back(x);
-        vertices.push_back(y);
-        vertices.push_back(z);
+        if (name == exportFormatExtensions[f] || name == exportFormatNames[f])
+        {
+            format = f;
+            return true;
+        }
     }
-
-    // Upload vertices data to GPU
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-
-    // Set attribute pointers
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-
-    // Draw line segments
-    glDrawArrays(GL_LINE_STRIP, 0, vertices.size() / 3);
-
-    if (renderSurface) // if user clicks extrude
+    for (int f = 0; f < PLOT_FORMAT_COUNT; ++f)
     {
-        // std::cout << "rendering ";
-        std::vector<glm::vec3> lineVertices;
-        for (size_t i = 0; i < vertices.size(); i += 3)
-        {
-            lineVertices.push_back(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
-        }
-
-        // Calculate + render normals
-        std::vector<glm::vec3> normals = calculateNormals(vertices);
-
-        // buffers for normals
-        unsigned int normalVBO, normalVAO;
-        glGenVertexArrays(1, &normalVAO);
-        glGenBuffers(1, &normalVBO);
-        glBindVertexArray(normalVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, normalVBO);
-
-        // Store normal vectors' data in VBO
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3), &normals[0], GL_STATIC_DRAW);
-
-        // Set vertex attribute pointer for position
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
-        glEnableVertexAttribArray(0);
-
-        // Draw the normal vectors
-        // Calculate vertices for line segments (control points to normals)
-        std::vector<glm::vec3> surfaceVertices; // to store vertices of point x on line, normal of said point, point x+1 on line (cont)
-        for (size_t i = 0; i < lineVertices.size() - 4; ++i)
-        {
-            surfaceVertices.push_back(lineVertices[i]);
-            surfaceVertices.push_back(lineVertices[i] + 0.5f * normals[i]);
-        }
-
-        // Store surface vertices' data in VBO
-        glBufferData(GL_ARRAY_BUFFER, surfaceVertices.size() * sizeof(glm::vec3), &surfaceVertices[0], GL_STATIC_DRAW);
-
-        // Set vertex attribute pointer for line segment vertices
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
-        glEnableVertexAttribArray(0);
-
-        // -- uncomment the 3 lines belw if you want to draw the line normals
-        // glDrawArrays(GL_LINES, 0, surfaceVertices.size());
-        // glPointSize(5.0f);
-        // glDrawArrays(GL_POINTS, 0, normals.size() * 2); // this draws out the normal end points
-
-        // Generate flat surface vertice
-        std::vector<glm::vec3> surfaceNormals(surfaceVertices.size());
-        std::vector<unsigned int> indices(surfaceVertices.size());
-        std::iota(indices.begin(), indices.end(), 0);
-        calculateTriangleStripNormals(surfaceVertices, indices, surfaceNormals);
-
-        // Extrude surface
-        std::vector<glm::vec3> extrudedVertices;
-        float extrusionDistance = 0.1; // adjust extrusion here
-        std::vector<unsigned int> topSurfaceIndices, bottomSurfaceIndices, frontSurfaceIndices, endSurfaceIndices, sideSurface1Indices, sideSurface2Indices;
-
-        extrudeSurface(surfaceVertices, surfaceNormals, extrusionDistance, extrudedVertices, topSurfaceIndices, bottomSurfaceIndices, frontSurfaceIndices, endSurfaceIndices, sideSurface1Indices, sideSurface2Indices);
-
-        std::vector<glm::vec3> topSurfaceNormals, bottomSurfaceNormals, frontSurfaceNormals, endSurfaceNormals, sideSurface1Normals, sideSurface2Normals;
-
-        calculateTriangleStripNormals(extrudedVertices, topSurfaceIndices, topSurfaceNormals, true);
-        calculateTriangleStripNormals(extrudedVertices, bottomSurfaceIndices, bottomSurfaceNormals);
-        calculateTriangleStripNormals(extrudedVertices, frontSurfaceIndices, frontSurfaceNormals);
-        calculateTriangleStripNormals(extrudedVertices, endSurfaceIndices, endSurfaceNormals);
-        calculateTriangleStripNormals(extrudedVertices, sideSurface1Indices, sideSurface1Normals);
-        calculateTriangleStripNormals(extrudedVertices, sideSurface2Indices, sideSurface2Normals);
-
-        // Create and bind VAO and VBO for extruded surface
-        unsigned int extrudedVAO, extrudedVBO;
-        glGenVertexArrays(1, &extrudedVAO);
-        glGenBuffers(1, &extrudedVBO);
-        glBindVertexArray(extrudedVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, extrudedVBO);
-        glBufferData(GL_ARRAY_BUFFER, extrudedVertices.size() * sizeof(glm::vec3), extrudedVertices.data(), GL_STATIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void *)0);
-        glEnableVertexAttribArray(0);
-
-        // Create and bind VBOs for surface indices
-        unsigned int topSurfaceIndexVBO, bottomSurfaceIndexVBO, frontSurfaceIndexVBO, endSurfaceIndexVBO, sideSurface1IndexVBO, sideSurface2IndexVBO;
-        unsigned int topSurfaceNormalsVBO, bottomSurfaceNormalsVBO, frontSurfaceNormalsVBO, endSurfaceNormalsVBO, sideSurface1NormalsVBO, sideSurface2NormalsVBO;
-
-        // Generate and bind VBOs for surface indices
-        generateAndBindIndexVBO(topSurfaceIndexVBO, topSurfaceIndices);
-        generateAndBindIndexVBO(bottomSurfaceIndexVBO, bottomSurfaceIndices);
-        generateAndBindIndexVBO(frontSurfaceIndexVBO, frontSurfaceIndices);
-        generateAndBindIndexVBO(endSurfaceIndexVBO, endSurfaceIndices);
-        generateAndBindIndexVBO(sideSurface1IndexVBO, sideSurface1Indices);
-        generateAndBindIndexVBO(sideSurface2IndexVBO, sideSurface2Indices);
-
-        // Generate and bind VBOs for surface normals
-        generateAndBindNormalVBO(topSurfaceNormalsVBO, topSurfaceNormals);
-        generateAndBindNormalVBO(bottomSurfaceNormalsVBO, bottomSurfaceNormals);
-        generateAndBindNormalVBO(frontSurfaceNormalsVBO, frontSurfaceNormals);
-        generateAndBindNormalVBO(endSurfaceNormalsVBO, endSurfaceNormals);
-        generateAndBindNormalVBO(sideSurface1NormalsVBO, sideSurface1Normals);
-        generateAndBindNormalVBO(sideSurface2NormalsVBO, sideSurface2Normals);
-
-        // Draw each surface
-        drawSurface(topSurfaceIndexVBO, topSurfaceNormalsVBO, topSurfaceIndices, topSurfaceIndices.size());
-        drawSurface(bottomSurfaceIndexVBO, bottomSurfaceNormalsVBO, bottomSurfaceIndices, bottomSurfaceIndices.size());
-        drawSurface(frontSurfaceIndexVBO, frontSurfaceNormalsVBO, frontSurfaceIndices, frontSurfaceIndices.size());
-        drawSurface(endSurfaceIndexVBO, endSurfaceNormalsVBO, endSurfaceIndices, endSurfaceIndices.size());
-        drawSurface(sideSurface1IndexVBO, sideSurface1NormalsVBO, sideSurface1Indices, sideSurface1Indices.size());
-        drawSurface(sideSurface2IndexVBO, sideSurface2NormalsVBO, sideSurface2Indices, sideSurface2Indices.size());
-
-        // Cleanup after rendering the extruded surface
-        glDeleteVertexArrays(1, &extrudedVAO);
-        glDeleteBuffers(1, &extrudedVBO);
-        glDeleteBuffers(1, &topSurfaceIndexVBO);
-        glDeleteBuffers(1, &bottomSurfaceIndexVBO);
+        if (name == plotFormatExtensions[f] || name == plotFormatNames[f])
+        {
+            format = EXPORT_FORMAT_COUNT + f;
+            return true;
+        }
+    }
+    if (name == CURVE_CODEC_EXTENSION)
+    {
+        format = HEADLESS_CURVE_FORMAT;
+        return true;
+    }
+    return false;
+}
 
-        // combining all normals into allNormals - this is for obj export
-        std::vector<std::vector<glm::vec3>> allNormalsList = {
-            topSurfaceNormals, bottomSurfaceNormals,
-            frontSurfaceNormals, endSurfaceNormals,
-            sideSurface1Normals, sideSurface2Normals};
+// Export from the command line. The mesh is streamed, so curves of any length fit in memory.
+int runHeadless(int argc, char **argv)
+{
+    const int presetIds[3] = {0, 1, 3}; // presets behind the UI buttons
+    std::string filename;
+    ExportSettings settings = {EXPORT_OBJ, false, OBJ_DEFAULT_PRECISION, false};
+    PlotSettings plot = plotSettings;
+    int format = EXPORT_OBJ;
+    bool formatGiven = false;
+    int preset = 1;
+    float time = HEADLESS_DEFAULT_TIME;
+    float step = HARMONOGRAPH_STEP;
+    float tolerance = -1.0f; // the default of the format
+    std::string replayFilename;
+    bool checksums = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (arg == "--quantize")
+        {
+            settings.quantize = true;
+            continue;
+        }
+        if (arg == "--checksums")
+        {
+            checksums = true;
+            continue;
+        }
+        if (!value)
+        {
+            printUsage(argv[0]);
+            return 1;
+        }
+        ++i;
 
-        std::vector<glm::vec3> allNormals;
+        bool valid = true;
+        if (arg == "--export")
+        {
+            filename = value;
+        }
+        else if (arg == "--replay")
+        {
+            replayFilename = value;
+        }
+        else if (arg == "--format")
+        {
+            valid = parseFormat(value, format);
+            formatGiven = true;
+        }
+        else if (arg == "--preset")
+        {
+            preset = atoi(value);
+            valid = preset >= 1 && preset <= 3;
+        }
+        else if (arg == "--time")
+        {
+            time = (float)atof(value);
+            valid = time > 0.0f;
+        }
+        else if (arg == "--step")
+        {
+            step = (float)atof(value);
+            valid = step > 0.0f;
+        }
+        else if (arg == "--precision")
+        {
+            settings.precision = atoi(value);
+            valid = settings.precision >= 1 && settings.precision <= 9;
+        }
+        else if (arg == "--tolerance")
+        {
+            tolerance = (float)atof(value);
+            valid = tolerance >= 0.0f;
+        }
+        else
+        {
+            valid = false;
+        }
 
-        int currentIndex = 0;
+        if (!valid)
+        {
+            std::cerr << "Error: Invalid option " << arg << " " << value << "\n";
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
 
-        constexpr int numGroups = 6;
-        int startingIndices[numGroups] = {0};
-        allNormals.clear();
+    if (!replayFilename.empty())
+    {
+        return replaySession(replayFilename, checksums) ? 0 : 1;
+    }
+    if (filename.empty())
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    size_t dot = filename.rfind('.');
+    if (!formatGiven && (dot == std::string::npos || !parseFormat(filename.substr(dot + 1), format)))
+    {
+        std::cerr << "Error: Unknown export format; use --format\n";
+        printUsage(argv[0]);
+        return 1;
+    }
 
-        for (int i = 0; i < numGroups; ++i)
+    SetPresets(presetIds[preset - 1]);
+    if (format == HEADLESS_CURVE_FORMAT)
+    {
+        if (!writeEncodedCurve(filename, currentParams(), time, step, tolerance >= 0.0f ? tolerance : CURVE_CODEC_DEFAULT_TOLERANCE))
         {
-            startingIndices[i] = currentIndex;
-            allNormals.insert(allNormals.end(), allNormalsList[i].begin(), allNormalsList[i].end());
-            currentIndex += allNormalsList[i].size();
+            return 1;
         }
-
-        if (isExported)
+    }
+    else if (format >= EXPORT_FORMAT_COUNT)
+    {
+        plot.tolerance = tolerance >= 0.0f ? tolerance : plot.tolerance;
+        plot.format = (PlotFormat)(format - EXPORT_FORMAT_COUNT);
+        if (!exportPlot(currentParams(), time, step, filename, plot))
         {
-            // std::cout << "exporting";
-            exportToObj(extrudedVertices, "harmonograph_object.obj", allNormals, startingIndices, topSurfaceIndices, bottomSurfaceIndices, frontSurfaceIndices, endSurfaceIndices, sideSurface1Indices, sideSurface2Indices);
-            isExported = false;
+            return 1;
         }
     }
-
-    // Clean up
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-    glDeleteBuffers(1, &VBO);
-    glDeleteVertexArrays(1, &VAO);
+    else
+    {
+        settings.format = (ExportFormat)format;
+        if (!exportStreamed(currentParams(), time, step, filename, settings))
+        {
+            return 1;
+        }
+    }
+    std::cout << "Exported " << filename << std::endl;
+    return 0;
 }
 
 ///=========================================================================================///
 ///                                      Main Function
 ///=========================================================================================///
 
-int main(void)
+int main(int argc, char **argv)
 {
+    // Any arguments select the headless export
+    if (argc > 1)
+    {
+        return runHeadless(argc, argv);
+    }
+
     GLFWwindow *window;
+    traceRecorder.setThreadName("Render");
 
     // Initialize the library
     if (!glfwInit())
@@ -825,6 +1273,7 @@ int main(void)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3); // Request OpenGL 3.x
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_SAMPLES, 0); // anti-aliasing happens in the scene target, whatever the platform default
 
     // Create a windowed mode window and its OpenGL context
     window = glfwCreateWindow(winWidth, winHeight, "Harmonograph", NULL, NULL);
@@ -838,12 +1287,22 @@ int main(void)
     // Make the window's context current
     glfwMakeContextCurrent(window);
 
+    // On high-DPI displays the framebuffer has more pixels than the window has screen coordinates
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    winWidth = framebufferWidth;
+    winHeight = framebufferHeight;
+
     ///// setting up the shaders
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); // correct resize
     glfwSetScrollCallback(window, scroll_callback);                    // scale
     glfwSetCursorPosCallback(window, cursor_pos_callback);             // translate OR rotate
     glfwSetKeyCallback(window, key_callback);                          // change color
     glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetCharCallback(window, char_callback);
+    glfwSetCursorEnterCallback(window, cursor_enter_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     // tell GLFW to capture the mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -860,7 +1319,7 @@ int main(void)
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
 
-    // configure multi-sampling
+    // configure multi-sampling; only the scene target has samples, see antiAliasing
     glEnable(GL_MULTISAMPLE);
 
     //// build and compile our shader program
@@ -939,9 +1398,23 @@ int main(void)
 
     // shader stuff ends here
 
+    createGeometryBuffers(geometryBuffers);
+    sceneTarget.create();
+    gpuProfiler.create();
+    if (allocationTracker.isEnabled())
+    {
+        allocationTracker.openLog(ALLOCATION_LOG_FILE);
+    }
+
     float animationTime = 0.0f; // Initialize animation time
     printf("%s\n", glGetString(GL_VERSION));
 
+    glfwSwapInterval(1);
+    latencyControl.setQueuedFrames(LATENCY_DEFAULT_QUEUED_FRAMES);
+    bool adaptiveVsync = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+    const GLFWvidmode *videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    double refreshPeriod = videoMode && videoMode->refreshRate > 0 ? 1.0 / videoMode->refreshRate : 1.0 / 60.0;
+
     const char *glsl_version = "#version 330";
 
     // Setup Dear ImGui context
@@ -995,14 +1468,51 @@ int main(void)
     phasePtr2[2] = 2 * M_PI;
 
     int freeze = 1;
+    RedrawState drawnState = currentRedrawState(currentParams(), animationTime, frameGovernor.step(), resolutionGovernor.scale());
+    ExportWorker::State drawnExportState = exportWorker.state();
+    int settleFrames = REDRAW_SETTLE_FRAMES;
 
     // Loop until the user closes the window
     while (!glfwWindowShouldClose(window))
     {
+        // Nothing changed for a few frames: sleep until input arrives, and skip the frame unless an export
+        // needs its progress shown
+        unsigned long inputBefore = inputEvents;
+        if (renderOnDemand && settleFrames == 0)
+        {
+            bool exporting = exportWorker.state() == ExportWorker::EXPORTING;
+            waitForInput(window, exporting ? IDLE_UPDATE_INTERVAL : IDLE_TIMEOUT);
+            if (inputEvents == inputBefore && !exporting && exportWorker.state() == drawnExportState)
+            {
+                continue;
+            }
+        }
+
+        // Keep the GPU queue short, then sample input as late as the vsync allows
+        latencyControl.waitForQueue();
+        if (lateInput && vsyncMode != VSYNC_OFF)
+        {
+            latencyControl.delayInput(refreshPeriod);
+        }
+        latencyControl.beginFrame();
+
+        frameProfiler.setEnabled(showProfiler || frameGovernor.isEnabled() || resolutionGovernor.isEnabled());
+        frameProfiler.beginFrame();
+        allocationTracker.beginFrame();
+        gpuProfiler.beginFrame();
+        TRACE_SCOPE("Frame");
+
+        // Geometry of the previous frame is no longer needed
+        frameArena.reset();
+
         // Process inputs
-        processInput(window);
-        glfwPollEvents();
+        {
+            PROFILE_SCOPE(PROFILE_INPUT);
+            processInput(window);
+            glfwPollEvents();
+        }
 
+        ProfileScope uiScope(PROFILE_IMGUI);
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
@@ -1049,6 +1559,113 @@ int main(void)
         {
             isExported = true;
         }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(70.0f);
+        ImGui::Combo("##Format", (int *)&exportSettings.format, exportFormatNames, EXPORT_FORMAT_COUNT);
+        ImGui::SameLine();
+        ImGui::Checkbox("Optimize", &exportSettings.optimize);
+        if (exportSettings.format == EXPORT_OBJ)
+        {
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(100.0f);
+            ImGui::SliderInt("Decimals", &exportSettings.precision, 1, 9, "%d", ImGuiSliderFlags_AlwaysClamp);
+        }
+        else if (exportSettings.format == EXPORT_GLB)
+        {
+            ImGui::SameLine();
+            ImGui::Checkbox("Quantize", &exportSettings.quantize);
+        }
+
+        ExportWorker::Kind exportKind = exportWorker.kind();
+        switch (exportWorker.state())
+        {
+        case ExportWorker::EXPORTING:
+            if (exportKind != ExportWorker::MESH)
+            {
+                ImGui::Text("Writing %s", exportWorker.filename().c_str());
+            }
+            else
+            {
+                ImGui::ProgressBar(exportWorker.progress(), ImVec2(200.0f, 0.0f));
+                ImGui::SameLine();
+                if (ImGui::Button("Cancel"))
+                {
+                    exportWorker.cancel();
+                }
+            }
+            if (size_t queuedJobs = exportWorker.queuedCount())
+            {
+                ImGui::SameLine();
+                ImGui::Text("%zu queued", queuedJobs);
+            }
+            break;
+        case ExportWorker::DONE:
+            if (exportKind == ExportWorker::PLOT)
+            {
+                ImGui::Text("Plotted %s: %zu moves", exportWorker.filename().c_str(), exportWorker.plotMoves());
+            }
+            else
+            {
+                ImGui::Text(exportKind == ExportWorker::DESIGN ? "Saved %s" : "Exported %s", exportWorker.filename().c_str());
+            }
+            break;
+        case ExportWorker::FAILED:
+            ImGui::Text("Writing %s failed", exportWorker.filename().c_str());
+            break;
+        case ExportWorker::CANCELLED:
+            ImGui::Text("Export cancelled");
+            break;
+        default:
+            break;
+        }
+
+        // The plot is evaluated, simplified and written on the export thread; its moves show once it is done
+        if (ImGui::Button("Plot"))
+        {
+            exportWorker.submitPlot(currentParams(), animationTime, plotSettings, std::string("harmonograph_plot.") + plotFormatExtensions[plotSettings.format]);
+        }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80.0f);
+        ImGui::Combo("##PlotFormat", (int *)&plotSettings.format, plotFormatNames, PLOT_FORMAT_COUNT);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120.0f);
+        ImGui::SliderFloat("Tolerance", &plotSettings.tolerance, 0.0f, 1.0f, "%.2f mm", ImGuiSliderFlags_AlwaysClamp);
+
+        // The design is written on the export thread from the parameters of the frame it was saved in
+        if (ImGui::Button("Save design"))
+        {
+            designJob = exportWorker.submitDesign(currentParams(), animationTime, DESIGN_FILENAME);
+        }
+        if (designJob && exportWorker.lastSucceeded(ExportWorker::DESIGN) >= designJob)
+        {
+            curveCache.open(DESIGN_FILENAME);
+            designJob = 0;
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Open design") && curveCache.open(DESIGN_FILENAME))
+        {
+            // Restore the parameters and the frozen, extruded curve the design was saved with
+            const CurveCacheHeader &header = curveCache.header();
+            amplitude = header.params.amplitude;
+            for (int i = 0; i < 3; ++i)
+            {
+                freqPtr1[i] = header.params.freq1[i];
+                freqPtr2[i] = header.params.freq2[i];
+                dampPtr1[i] = header.params.damp1[i];
+                dampPtr2[i] = header.params.damp2[i];
+                phasePtr1[i] = header.params.phase1[i];
+                phasePtr2[i] = header.params.phase2[i];
+            }
+            animationTime = header.animationTime;
+            freeze = 2;
+            isAnimating = false;
+        }
+        if (curveCache.isOpen())
+        {
+            ImGui::SameLine();
+            ImGui::Text("%zu samples cached", curveCache.sampleCount());
+        }
+
         if (ImGui::Button("Preset 1"))
         {
             SetPresets(0);
@@ -1063,9 +1680,163 @@ int main(void)
         {
             SetPresets(3);
         }
+
+        const FrameArena::Stats &arenaStats = frameArena.frameStats();
+        ImGui::Text("Frame geometry: %zu allocations, %.1f KB, %zu heap blocks",
+                    arenaStats.allocations, arenaStats.bytes / 1024.0f, arenaStats.heapAllocations);
+        if (allocationTracker.frameCount())
+        {
+            const AllocationFrame &heapFrame = allocationTracker.frame(0);
+            ImGui::Text("Heap: %llu allocations, %.1f KB last frame (worst %llu, %.1f KB); peak live %.1f MB",
+                        (unsigned long long)heapFrame.totalAllocations(), heapFrame.totalBytes() / 1024.0f,
+                        (unsigned long long)allocationTracker.peakFrameAllocations(), allocationTracker.peakFrameBytes() / 1024.0f,
+                        allocationTracker.peakHeap() / 1048576.0f);
+            ImGui::Text("Other threads: %llu allocations; RSS %.1f MB, high water %.1f MB", (unsigned long long)heapFrame.workerAllocations,
+                        heapFrame.rss / 1048576.0f, allocationTracker.peakRss() / 1048576.0f);
+        }
+        ImGui::Checkbox("Profiler", &showProfiler);
+        ImGui::SameLine();
+        ImGui::Checkbox("Render on demand", &renderOnDemand);
+        ImGui::SameLine();
+        ImGui::Checkbox("Background geometry", &backgroundGeometry);
+        if (backgroundGeometry)
+        {
+            ImGui::SameLine();
+            ImGui::Text("(%.1f ms)", 1e3f * geometryBuildSeconds);
+        }
+        bool governed = frameGovernor.isEnabled();
+        if (ImGui::Checkbox("Frame budget", &governed))
+        {
+            frameGovernor.setEnabled(governed);
+        }
+        bool dynamicResolution = resolutionGovernor.isEnabled();
+        if (governed || dynamicResolution)
+        {
+            float targetMs = 1e3f * frameGovernor.target();
+            ImGui::SameLine();
+            ImGui::PushItemWidth(120.0f);
+            if (ImGui::SliderFloat("##targetMs", &targetMs, 4.0f, 50.0f, "%.1f ms"))
+            {
+                frameGovernor.setTarget(targetMs * 1e-3f);
+            }
+            ImGui::PopItemWidth();
+        }
+        if (governed)
+        {
+            ImGui::SameLine();
+            ImGui::Text("Quality %d/%d (step %.4f), %.1f ms%s", GOVERNOR_LEVELS - frameGovernor.level(), GOVERNOR_LEVELS,
+                        frameGovernor.step(), 1e3f * frameGovernor.averageFrame(), sessionRecorder.isRecording() ? ", held" : "");
+        }
+        if (ImGui::Checkbox("Dynamic resolution", &dynamicResolution))
+        {
+            resolutionGovernor.setEnabled(dynamicResolution);
+        }
+        ImGui::SameLine();
+        if (!dynamicResolution)
+        {
+            float scalePercent = 100.0f * resolutionGovernor.scale();
+            ImGui::PushItemWidth(120.0f);
+            if (ImGui::SliderFloat("##sceneScale", &scalePercent, 100.0f * RESOLUTION_SCALE_MIN, 100.0f, "%.0f%%"))
+            {
+                resolutionGovernor.setScale(scalePercent / 100.0f);
+            }
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+        }
+        float sceneScale = resolutionGovernor.scale();
+        ImGui::Text("Scene %dx%d (%.0f%%)", (int)(winWidth * sceneScale + 0.5f), (int)(winHeight * sceneScale + 0.5f), 100.0f * sceneScale);
+        ImGui::SameLine();
+        ImGui::Checkbox("Sharpen", &sharpenScene);
+        ImGui::Text("Anti-aliasing");
+        ImGui::SameLine();
+        ImGui::PushItemWidth(120.0f);
+        ImGui::Combo("##antiAliasing", (int *)&antiAliasing, antiAliasingNames, AA_MODE_COUNT);
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        ImGui::Text("Vsync");
+        ImGui::SameLine();
+        ImGui::PushItemWidth(100.0f);
+        if (ImGui::Combo("##vsync", &vsyncMode, vsyncModeNames, adaptiveVsync ? VSYNC_MODE_COUNT : VSYNC_ADAPTIVE))
+        {
+            glfwSwapInterval(vsyncMode == VSYNC_ADAPTIVE ? -1 : vsyncMode);
+        }
+        ImGui::PopItemWidth();
+        int queuedFrames = latencyControl.queuedFrames();
+        ImGui::PushItemWidth(120.0f);
+        if (ImGui::SliderInt("Queued frames", &queuedFrames, 0, LATENCY_MAX_QUEUED_FRAMES, queuedFrames ? "%d" : "driver"))
+        {
+            latencyControl.setQueuedFrames(queuedFrames);
+        }
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        ImGui::Checkbox("Late input", &lateInput);
+        if (latencyControl.sampleCount())
+        {
+            ImGui::Text("Input to swap: mean %.1f ms, p95 %.1f ms, max %.1f ms; queue wait %.1f ms", 1e3 * latencyControl.mean(),
+                        1e3 * latencyControl.percentile(0.95), 1e3 * latencyControl.percentile(1.0), 1e3 * latencyControl.queueWait());
+        }
+        if (antiAliasingSamples(antiAliasing) && sceneTarget.samples() && sceneTarget.samples() < antiAliasingSamples(antiAliasing))
+        {
+            ImGui::SameLine();
+            ImGui::Text("(%d samples supported)", sceneTarget.samples());
+        }
+        bool recordTrace = traceRecorder.isRecording();
+        if (ImGui::Checkbox("Record trace", &recordTrace))
+        {
+            if (recordTrace)
+            {
+                traceRecorder.start(TRACE_FILE);
+            }
+            else
+            {
+                traceRecorder.stop();
+            }
+        }
+        if (recordTrace || traceRecorder.eventsWritten())
+        {
+            ImGui::SameLine();
+            ImGui::Text("%llu events, %llu dropped", (unsigned long long)traceRecorder.eventsWritten(),
+                        (unsigned long long)traceRecorder.eventsDropped());
+        }
+        bool recordSession = sessionRecorder.isRecording();
+        if (ImGui::Checkbox("Record session", &recordSession))
+        {
+            if (recordSession)
+            {
+                sessionRecorder.start(SESSION_FILE, frameGovernor.step());
+            }
+            else
+            {
+                sessionRecorder.stop();
+            }
+        }
+        if (recordSession || sessionRecorder.frameCount())
+        {
+            ImGui::SameLine();
+            ImGui::Text("%llu frames", (unsigned long long)sessionRecorder.frameCount());
+        }
         ImGui::End();
 
-        // Render OpenGL here
+        if (showProfiler)
+        {
+            drawProfilerWindow(&showProfiler);
+        }
+        uiScope.stop();
+
+        // Render OpenGL here, offscreen when the scene is drawn below window resolution
+        int sceneWidth = std::max(1, (int)(winWidth * resolutionGovernor.scale() + 0.5f));
+        int sceneHeight = std::max(1, (int)(winHeight * resolutionGovernor.scale() + 0.5f));
+        bool offscreen = (resolutionGovernor.scale() < 1.0f || antiAliasing != AA_NONE) &&
+                         sceneTarget.resize(sceneWidth, sceneHeight, antiAliasingSamples(antiAliasing));
+        if (offscreen)
+        {
+            sceneTarget.bind();
+        }
+        else
+        {
+            glViewport(0, 0, winWidth, winHeight);
+        }
+        glUseProgram(shaderProgram);
         glClearColor(0.95f, 0.95f, 0.95f, 1.0f); // change background colour
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -1081,10 +1852,27 @@ int main(void)
         glUniform3fv(meshColorLoc2, 1, &meshColorTable2[meshColorID2][0]);
         glUniform3fv(viewPosLoc, 1, &camera_position[0]);
 
+        if (sessionRecorder.isRecording())
+        {
+            SessionFrame sessionFrame = {currentParams(), animationTime, !isAnimating, isExported, exportSettings, modelMatrix, (int)winWidth, (int)winHeight};
+            sessionRecorder.record(sessionFrame);
+        }
         drawHarmonograph(animationTime, !isAnimating);
 
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // The UI is drawn over the resolved and scaled scene at native resolution
+        if (offscreen)
+        {
+            PROFILE_SCOPE(PROFILE_POST);
+            GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_POST);
+            sceneTarget.present(winWidth, winHeight, sharpenScene ? SCENE_SHARPNESS : 0.0f, antiAliasing == AA_FXAA);
+        }
+
+        {
+            PROFILE_SCOPE(PROFILE_IMGUI);
+            GPU_PROFILE_SCOPE(gpuProfiler, PROFILE_IMGUI);
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
 
         if (freeze & 1)
         {
@@ -1092,11 +1880,42 @@ int main(void)
         }
 
         // Swap front and back buffers
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE(PROFILE_SWAP);
+            latencyControl.beforeSwap();
+            glfwSwapBuffers(window);
+            latencyControl.frameSwapped();
+        }
+        allocationTracker.endFrame();
+        frameProfiler.endFrame();
+        updateFrameGovernor();
+        updateResolutionGovernor();
+
+        // Any input, a change of the picture, a running animation, an export waiting for the surface being
+        // drawn, geometry still being built or an active widget keeps the loop drawing. An Export press
+        // while the curve is not extruded waits for the Extrude press, which is input itself.
+        RedrawState state = currentRedrawState(currentParams(), animationTime, frameGovernor.step(), resolutionGovernor.scale());
+        bool exportDue = isExported && !isAnimating;
+        if (inputEvents != inputBefore || !sameRedrawState(state, drawnState) || (freeze & 1) || exportDue || geometryWorker.isBusy() ||
+            ImGui::IsAnyItemActive())
+        {
+            settleFrames = REDRAW_SETTLE_FRAMES;
+        }
+        else if (settleFrames > 0)
+        {
+            --settleFrames;
+        }
+        drawnState = state;
+        drawnExportState = exportWorker.state();
 
         // Poll for and process events
     }
 
+    traceRecorder.stop();
+    sessionRecorder.stop();
+    geometryWorker.shutdown();
+    exportWorker.shutdown();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -1104,6 +1923,10 @@ int main(void)
     // Deallocate all resources
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
+    deleteGeometryBuffers(geometryBuffers);
+    gpuProfiler.destroy();
+    sceneTarget.destroy();
+    latencyControl.destroy();
     glDeleteProgram(shaderProgram);
 
     glfwTerminate();
@@ -0,0 +1,1286 @@
+#include "meshExport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <climits>
+#include <iostream>
+#include <unordered_map>
+
+#include "bufferedWriter.h"
+#include "parallel.h"
+
+///=========================================================================================///
+///                                    Export Mesh Building
+///=========================================================================================///
+
+namespace
+{
+
+// Bit pattern of a vector, with -0 folded into +0 so both weld together
+struct Vec3Key
+{
+    uint32_t bits[3];
+
+    explicit Vec3Key(const glm::vec3 &v)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            float f = v[i] + 0.0f;
+            memcpy(&bits[i], &f, sizeof(float));
+        }
+    }
+
+    bool operator==(const Vec3Key &other) const
+    {
+        return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+    }
+};
+
+struct Vec3KeyHash
+{
+    size_t operator()(const Vec3Key &key) const
+    {
+        uint64_t h = 1469598103934665603ull;
+        for (int i = 0; i < 3; ++i)
+        {
+            h = (h ^ key.bits[i]) * 1099511628211ull;
+        }
+        return (size_t)h;
+    }
+};
+
+// Map every vector to the index of its first identical occurrence in unique
+void weldVectors(const glm::vec3 *vectors, size_t count, std::vector<glm::vec3> &unique, std::vector<unsigned int> &remap)
+{
+    std::unordered_map<Vec3Key, unsigned int, Vec3KeyHash> lookup;
+    lookup.reserve(count);
+    unique.clear();
+    remap.resize(count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto inserted = lookup.insert(std::make_pair(Vec3Key(vectors[i]), (unsigned int)unique.size()));
+        if (inserted.second)
+        {
+            unique.push_back(vectors[i]);
+        }
+        remap[i] = inserted.first->second;
+    }
+}
+
+}
+
+bool buildExportMesh(const ExtrudedMesh &mesh, ExportMesh &out, bool optimize, ExportProgress *progress)
+{
+    size_t stripCount = mesh.indices.size();
+
+    // Each strip position becomes one vertex
+    std::vector<unsigned int> positionRemap, normalRemap;
+    if (optimize)
+    {
+        weldVectors(mesh.vertices.data(), mesh.vertices.size(), out.positions, positionRemap);
+        weldVectors(mesh.normals.data(), mesh.normals.size(), out.normals, normalRemap);
+        if (!reportProgress(progress, 0.3f))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        out.positions.assign(mesh.vertices.begin(), mesh.vertices.end());
+        out.normals.assign(mesh.normals.begin(), mesh.normals.end());
+    }
+
+    out.vertexPositions.resize(stripCount);
+    out.vertexNormals.resize(stripCount);
+    for (size_t k = 0; k < stripCount; ++k)
+    {
+        out.vertexPositions[k] = optimize ? positionRemap[mesh.indices[k]] : mesh.indices[k];
+        out.vertexNormals[k] = optimize ? normalRemap[k] : k;
+    }
+
+    // Unroll the strips, flipping every other triangle to keep the winding order
+    out.triangles.clear();
+    out.triangles.reserve(3 * stripCount);
+    for (int s = 0; s < SURFACE_COUNT; ++s)
+    {
+        size_t start = mesh.surfaceStart[s];
+        size_t count = mesh.surfaceSize(s);
+        for (size_t i = 0; i + 2 < count; ++i)
+        {
+            size_t k = start + i;
+            unsigned int v1 = (i % 2 == 0) ? k : k + 2;
+            unsigned int v2 = k + 1;
+            unsigned int v3 = (i % 2 == 0) ? k + 2 : k;
+
+            // welding can collapse a triangle onto a line
+            if (optimize && (out.vertexPositions[v1] == out.vertexPositions[v2] || out.vertexPositions[v2] == out.vertexPositions[v3] || out.vertexPositions[v1] == out.vertexPositions[v3]))
+            {
+                continue;
+            }
+            out.triangles.push_back(v1);
+            out.triangles.push_back(v2);
+            out.triangles.push_back(v3);
+        }
+    }
+
+    if (!optimize)
+    {
+        return reportProgress(progress, 1.0f);
+    }
+
+    // Weld vertices that share both their position and their normal
+    {
+        std::unordered_map<uint64_t, unsigned int> lookup;
+        lookup.reserve(stripCount);
+        std::vector<unsigned int> vertexRemap(stripCount);
+        std::vector<unsigned int> vertexPositions, vertexNormals;
+        for (size_t k = 0; k < stripCount; ++k)
+        {
+            uint64_t key = ((uint64_t)out.vertexPositions[k] << 32) | out.vertexNormals[k];
+            auto inserted = lookup.insert(std::make_pair(key, (unsigned int)vertexPositions.size()));
+            if (inserted.second)
+            {
+                vertexPositions.push_back(out.vertexPositions[k]);
+                vertexNormals.push_back(out.vertexNormals[k]);
+            }
+            vertexRemap[k] = inserted.first->second;
+        }
+        for (auto &v : out.triangles)
+        {
+            v = vertexRemap[v];
+        }
+        out.vertexPositions.swap(vertexPositions);
+        out.vertexNormals.swap(vertexNormals);
+    }
+
+    if (!reportProgress(progress, 0.5f))
+    {
+        return false;
+    }
+    optimizeVertexCache(out.triangles, out.vertexCount());
+    if (!reportProgress(progress, 0.9f))
+    {
+        return false;
+    }
+
+    // Renumber vertices, then positions and normals, in the order the triangles first touch them
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> vertexOrder(out.vertexCount(), unused);
+    std::vector<unsigned int> positionOrder(out.positions.size(), unused);
+    std::vector<unsigned int> normalOrder(out.normals.size(), unused);
+    std::vector<unsigned int> vertexPositions, vertexNormals;
+    std::vector<glm::vec3> positions, normals;
+    vertexPositions.reserve(out.vertexCount());
+    vertexNormals.reserve(out.vertexCount());
+
+    for (auto &v : out.triangles)
+    {
+        if (vertexOrder[v] == unused)
+        {
+            unsigned int p = out.vertexPositions[v];
+            unsigned int n = out.vertexNormals[v];
+            if (positionOrder[p] == unused)
+            {
+                positionOrder[p] = positions.size();
+                positions.push_back(out.positions[p]);
+            }
+            if (normalOrder[n] == unused)
+            {
+                normalOrder[n] = normals.size();
+                normals.push_back(out.normals[n]);
+            }
+
+            vertexOrder[v] = vertexPositions.size();
+            vertexPositions.push_back(positionOrder[p]);
+            vertexNormals.push_back(normalOrder[n]);
+        }
+        v = vertexOrder[v];
+    }
+
+    // anything no triangle references is dropped
+    out.positions.swap(positions);
+    out.normals.swap(normals);
+    out.vertexPositions.swap(vertexPositions);
+    out.vertexNormals.swap(vertexNormals);
+    return reportProgress(progress, 1.0f);
+}
+
+///=========================================================================================///
+///                                  Vertex Cache Optimization
+///=========================================================================================///
+
+void optimizeVertexCache(std::vector<unsigned int> &triangles, size_t vertexCount, unsigned int cacheSize)
+{
+    size_t triangleCount = triangles.size() / 3;
+    if (triangleCount == 0)
+    {
+        return;
+    }
+
+    // Triangles around each vertex (compressed adjacency lists)
+    std::vector<unsigned int> adjacencyStart(vertexCount + 1, 0);
+    for (auto v : triangles)
+    {
+        adjacencyStart[v + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyStart[v + 1] += adjacencyStart[v];
+    }
+    std::vector<unsigned int> adjacency(triangles.size());
+    std::vector<unsigned int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            adjacency[fill[triangles[3 * t + c]]++] = t;
+        }
+    }
+
+    std::vector<unsigned int> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        liveTriangles[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+    }
+    std::vector<unsigned int> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(triangles.size());
+
+    unsigned int time = cacheSize + 1;
+    size_t cursor = 0;
+    long fanning = 0;
+
+    while (fanning >= 0)
+    {
+        // Emit every remaining triangle around the fanning vertex
+        candidates.clear();
+        for (unsigned int a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; ++a)
+        {
+            unsigned int t = adjacency[a];
+            if (emitted[t])
+            {
+                continue;
+            }
+            for (int c = 0; c < 3; ++c)
+            {
+                unsigned int v = triangles[3 * t + c];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = time++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // Continue with the candidate that will still be in the cache after its own fan
+        fanning = -1;
+        long best = -1;
+        for (auto v : candidates)
+        {
+            if (liveTriangles[v] > 0)
+            {
+                long priority = 0;
+                if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                {
+                    priority = time - cacheTime[v];
+                }
+                if (priority > best)
+                {
+                    best = priority;
+                    fanning = v;
+                }
+            }
+        }
+
+        // Dead end: go back to a recently used vertex, or to the next one with triangles left
+        while (fanning < 0 && !deadEnd.empty())
+        {
+            unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+            {
+                fanning = v;
+            }
+        }
+        while (fanning < 0 && cursor < vertexCount)
+        {
+            if (liveTriangles[cursor] > 0)
+            {
+                fanning = cursor;
+            }
+            cursor++;
+        }
+    }
+
+    triangles.swap(output);
+}
+
+///=========================================================================================///
+///                                       Export OBJ
+///=========================================================================================///
+
+const char *exportFormatNames[EXPORT_FORMAT_COUNT] = {"OBJ", "STL", "PLY", "GLB"};
+const char *exportFormatExtensions[EXPORT_FORMAT_COUNT] = {"obj", "stl", "ply", "glb"};
+
+#define EXPORT_PROGRESS_INTERVAL 65536 // records written between progress reports
+
+// Stop a cancelled export and remove what was written of it
+static bool abortExport(BufferedWriter &writer, const std::string &filename)
+{
+    writer.close();
+    remove(filename.c_str());
+    return false;
+}
+
+static bool closeExport(BufferedWriter &writer, const std::string &filename)
+{
+    if (!writer.close())
+    {
+        std::cerr << "Error: Failed writing " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+#define OBJ_LINE_MAX (3 + 3 * (FORMAT_FLOAT_MAX + 1) + 1) // longest v/vn record; f records are shorter
+
+// "v x y z\n" or "vn x y z\n"
+static inline char *formatObjVector(char *out, const char *tag, size_t tagLength, const glm::vec3 &v, int precision)
+{
+    memcpy(out, tag, tagLength);
+    out += tagLength;
+    for (int i = 0; i < 3; ++i)
+    {
+        *out++ = ' ';
+        out = formatFloat(out, v[i], precision);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+// " v//vn" of a face corner, with 0-based indices written 1-based
+static inline char *formatObjCorner(char *out, unsigned int position, unsigned int normal)
+{
+    *out++ = ' ';
+    out = formatUInt(out, position + 1);
+    *out++ = '/';
+    *out++ = '/';
+    return formatUInt(out, normal + 1);
+}
+
+// "f v//vn v//vn v//vn\n"
+static inline char *formatObjFace(char *out, const ExportMesh &mesh, size_t triangle)
+{
+    *out++ = 'f';
+    for (int c = 0; c < 3; ++c)
+    {
+        unsigned int v = mesh.triangles[3 * triangle + c];
+        out = formatObjCorner(out, mesh.vertexPositions[v], mesh.vertexNormals[v]);
+    }
+    *out++ = '\n';
+    return out;
+}
+
+#define OBJ_CHUNK_RECORDS 16384 // records one task formats into its own block
+#define OBJ_BATCH_BLOCKS 4       // blocks per thread formatted between two writes
+
+// A run of records of one OBJ section
+struct ObjChunk
+{
+    enum Section
+    {
+        POSITIONS,
+        NORMALS,
+        FACES
+    } section;
+    size_t begin, end;
+};
+
+// Text one task formats; the storage is reused from batch to batch
+struct FormatBlock
+{
+    std::vector<char> data;
+    size_t used;
+
+    char *reserve(size_t size)
+    {
+        if (data.size() < size)
+        {
+            data.resize(size);
+        }
+        return data.data();
+    }
+};
+
+// Format count blocks in parallel and append them to the file in order, so the file is the same as
+// a serial export while only one batch of text is held in memory
+static void formatBlocksInOrder(BufferedWriter &writer, std::vector<FormatBlock> &blocks, size_t count, const std::function<void(size_t, FormatBlock &)> &format)
+{
+    parallelFor(count, [&](size_t i)
+                { format(i, blocks[i]); });
+
+    std::vector<const char *> blockData(count);
+    std::vector<size_t> blockSizes(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        blockData[i] = blocks[i].data.data();
+        blockSizes[i] = blocks[i].used;
+    }
+    writer.writeBlocks(blockData.data(), blockSizes.data(), count);
+}
+
+static void formatObjChunk(const ExportMesh &mesh, const ObjChunk &chunk, int precision, FormatBlock &block)
+{
+    char *out = block.reserve((chunk.end - chunk.begin) * OBJ_LINE_MAX);
+    for (size_t i = chunk.begin; i < chunk.end; ++i)
+    {
+        switch (chunk.section)
+        {
+        case ObjChunk::POSITIONS:
+            out = formatObjVector(out, "v", 1, mesh.positions[i], precision);
+            break;
+        case ObjChunk::NORMALS:
+            out = formatObjVector(out, "vn", 2, mesh.normals[i], precision);
+            break;
+        case ObjChunk::FACES:
+            out = formatObjFace(out, mesh, i);
+            break;
+        }
+    }
+    block.used = out - block.data.data();
+}
+
+bool exportToObj(const ExportMesh &mesh, const std::string &filename, int precision, ExportProgress *progress)
+{
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+
+    // Cut the vertices, normals and faces into chunks, in file order
+    std::vector<ObjChunk> chunks;
+    const size_t sectionSizes[3] = {mesh.positions.size(), mesh.normals.size(), mesh.triangleCount()};
+    for (int section = ObjChunk::POSITIONS; section <= ObjChunk::FACES; ++section)
+    {
+        for (size_t begin = 0; begin < sectionSizes[section]; begin += OBJ_CHUNK_RECORDS)
+        {
+            ObjChunk chunk = {(ObjChunk::Section)section, begin, std::min(sectionSizes[section], begin + OBJ_CHUNK_RECORDS)};
+            chunks.push_back(chunk);
+        }
+    }
+
+    // Format a few chunks per thread at a time
+    std::vector<FormatBlock> blocks(OBJ_BATCH_BLOCKS * parallelThreadCount());
+    for (size_t first = 0; first < chunks.size(); first += blocks.size())
+    {
+        size_t count = std::min(blocks.size(), chunks.size() - first);
+        formatBlocksInOrder(writer, blocks, count, [&](size_t i, FormatBlock &block)
+                            { formatObjChunk(mesh, chunks[first + i], precision, block); });
+
+        if (!reportProgress(progress, (float)(first + count) / chunks.size()))
+        {
+            return abortExport(writer, filename);
+        }
+    }
+
+    return closeExport(writer, filename);
+}
+
+///=========================================================================================///
+///                                 Export Binary STL / PLY / GLB
+///=========================================================================================///
+
+// 80 byte header (must not start with "solid"), then the facet count
+static void writeStlHeader(BufferedWriter &writer, size_t triangleCount)
+{
+    char *out = writer.reserve(84);
+    memset(out, 0, 80);
+    memcpy(out, "Harmonograph binary STL", 23);
+    writer.commit(putUInt32LE(out + 80, triangleCount));
+}
+
+// Facet normal from the winding, three corners, attribute byte count
+static void writeStlFacet(BufferedWriter &writer, const glm::vec3 *corners)
+{
+    glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+    if (glm::length(normal) > 0.0f)
+    {
+        normal = glm::normalize(normal);
+    }
+
+    char *out = writer.reserve(50);
+    for (int i = 0; i < 3; ++i)
+    {
+        out = putFloatLE(out, normal[i]);
+    }
+    for (int c = 0; c < 3; ++c)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            out = putFloatLE(out, corners[c][i]);
+        }
+    }
+    writer.commit(putUInt16LE(out, 0));
+}
+
+bool exportToStl(const ExportMesh &mesh, const std::string &filename, ExportProgress *progress)
+{
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+
+    writeStlHeader(writer, mesh.triangleCount());
+
+    for (size_t t = 0; t < mesh.triangleCount(); ++t)
+    {
+        if (t % EXPORT_PROGRESS_INTERVAL == 0 && !reportProgress(progress, (float)t / mesh.triangleCount()))
+        {
+            return abortExport(writer, filename);
+        }
+
+        glm::vec3 corners[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            corners[c] = mesh.positions[mesh.vertexPositions[mesh.triangles[3 * t + c]]];
+        }
+        writeStlFacet(writer, corners);
+    }
+
+    return closeExport(writer, filename);
+}
+
+static void writePlyHeader(BufferedWriter &writer, size_t vertexCount, size_t triangleCount)
+{
+    char header[512];
+    int headerSize = snprintf(header, sizeof(header),
+                              "ply\n"
+                              "format binary_little_endian 1.0\n"
+                              "comment Harmonograph\n"
+                              "element vertex %zu\n"
+                              "property float x\nproperty float y\nproperty float z\n"
+                              "property float nx\nproperty float ny\nproperty float nz\n"
+                              "element face %zu\n"
+                              "property list uchar uint vertex_indices\n"
+                              "end_header\n",
+                              vertexCount, triangleCount);
+    writer.write(header, headerSize);
+}
+
+static void writePlyVertex(BufferedWriter &writer, const glm::vec3 &position, const glm::vec3 &normal)
+{
+    char *out = writer.reserve(24);
+    for (int i = 0; i < 3; ++i)
+    {
+        out = putFloatLE(out, position[i]);
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        out = putFloatLE(out, normal[i]);
+    }
+    writer.commit(out);
+}
+
+static void writePlyFace(BufferedWriter &writer, const unsigned int *corners)
+{
+    char *out = writer.reserve(13);
+    *out++ = 3;
+    for (int c = 0; c < 3; ++c)
+    {
+        out = putUInt32LE(out, corners[c]);
+    }
+    writer.commit(out);
+}
+
+bool exportToPly(const ExportMesh &mesh, const std::string &filename, ExportProgress *progress)
+{
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+
+    writePlyHeader(writer, mesh.vertexCount(), mesh.triangleCount());
+
+    size_t records = mesh.vertexCount() + mesh.triangleCount();
+    for (size_t v = 0; v < mesh.vertexCount(); ++v)
+    {
+        if (v % EXPORT_PROGRESS_INTERVAL == 0 && !reportProgress(progress, (float)v / records))
+        {
+            return abortExport(writer, filename);
+        }
+
+        writePlyVertex(writer, mesh.positions[mesh.vertexPositions[v]], mesh.normals[mesh.vertexNormals[v]]);
+    }
+
+    for (size_t t = 0; t < mesh.triangleCount(); ++t)
+    {
+        if (t % EXPORT_PROGRESS_INTERVAL == 0 && !reportProgress(progress, (float)(mesh.vertexCount() + t) / records))
+        {
+            return abortExport(writer, filename);
+        }
+
+        writePlyFace(writer, &mesh.triangles[3 * t]);
+    }
+
+    return closeExport(writer, filename);
+}
+
+// Append printf-style text to a string
+static void appendFormat(std::string &text, const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int size = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    text.append(buffer, std::min((size_t)size, sizeof(buffer) - 1));
+}
+
+#define GLTF_FLOAT 5126
+#define GLTF_BYTE 5120
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_ARRAY_BUFFER 34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+#define GLB_JSON_MAX_BYTES 8192 // longest JSON chunk formatGlbJson can write; each appendFormat piece is capped
+
+// What the GLB header describes: one interleaved position/normal buffer, then the indices
+struct GlbLayout
+{
+    bool quantize;
+    glm::vec3 center;
+    float scale; // quantized positions are (position - center) / scale in [-1, 1]
+    size_t vertexCount, indexCount;
+    glm::vec3 accessorMin, accessorMax; // bounds of the stored positions
+
+    // interleaved position + normal: 3 floats + 3 floats, or 3 shorts + pad + 3 bytes + pad
+    size_t stride() const { return quantize ? 12 : 24; }
+    size_t normalOffset() const { return quantize ? 8 : 12; }
+    bool shortIndices() const { return vertexCount <= 0xffff; }
+    size_t vertexBytes() const { return vertexCount * stride(); }
+    size_t indexBytes() const { return indexCount * (shortIndices() ? 2 : 4); }
+    size_t binaryBytes() const { return (vertexBytes() + indexBytes() + 3) & ~(size_t)3; }
+};
+
+// Quantized positions are stored relative to the centre of the bounds and scaled uniformly,
+// so the node transform restores them without skewing the normals
+static void setGlbBounds(GlbLayout &layout, const glm::vec3 &lower, const glm::vec3 &upper)
+{
+    layout.center = 0.5f * (lower + upper);
+    glm::vec3 extent = 0.5f * (upper - lower);
+    layout.scale = std::max(extent.x, std::max(extent.y, extent.z));
+    if (layout.scale <= 0.0f)
+    {
+        layout.scale = 1.0f;
+    }
+}
+
+static inline float quantizeGlbCoordinate(const GlbLayout &layout, float value, int axis)
+{
+    return glm::clamp(std::round((value - layout.center[axis]) / layout.scale * 32767.0f), -32767.0f, 32767.0f);
+}
+
+// Pack one vertex; stored is the position as it ends up in the file
+static inline char *putGlbVertex(char *out, const GlbLayout &layout, const glm::vec3 &position, const glm::vec3 &normal, glm::vec3 &stored)
+{
+    stored = position;
+    if (layout.quantize)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            float q = quantizeGlbCoordinate(layout, position[i], i);
+            stored[i] = q;
+            out = putUInt16LE(out, (uint16_t)(int16_t)q);
+        }
+        out = putUInt16LE(out, 0);
+        for (int i = 0; i < 3; ++i)
+        {
+            *out++ = (char)(int8_t)glm::clamp(std::round(normal[i] * 127.0f), -127.0f, 127.0f);
+        }
+        *out++ = 0;
+    }
+    else
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            out = putFloatLE(out, position[i]);
+        }
+        for (int i = 0; i < 3; ++i)
+        {
+            out = putFloatLE(out, normal[i]);
+        }
+    }
+    return out;
+}
+
+static std::string formatGlbJson(const GlbLayout &layout)
+{
+    bool quantize = layout.quantize;
+    std::string json;
+    appendFormat(json, "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Harmonograph\"},");
+    if (quantize)
+    {
+        json += "\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"],";
+    }
+    json += "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0";
+    if (quantize)
+    {
+        float scale = layout.scale / 32767.0f;
+        appendFormat(json, ",\"translation\":[%.9g,%.9g,%.9g],\"scale\":[%.9g,%.9g,%.9g]",
+                     layout.center.x, layout.center.y, layout.center.z, scale, scale, scale);
+    }
+    json += "}],\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1},\"indices\":2,\"mode\":4}]}],";
+    appendFormat(json, "\"buffers\":[{\"byteLength\":%zu}],", layout.binaryBytes());
+    appendFormat(json, "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%zu,\"byteStride\":%zu,\"target\":%d},",
+                 layout.vertexBytes(), layout.stride(), GLTF_ARRAY_BUFFER);
+    appendFormat(json, "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":%d}],",
+                 layout.vertexBytes(), layout.indexBytes(), GLTF_ELEMENT_ARRAY_BUFFER);
+    appendFormat(json, "\"accessors\":[{\"bufferView\":0,\"byteOffset\":0,\"componentType\":%d,%s\"count\":%zu,\"type\":\"VEC3\","
+                       "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},",
+                 quantize ? GLTF_SHORT : GLTF_FLOAT, quantize ? "\"normalized\":false," : "", layout.vertexCount,
+                 layout.accessorMin.x, layout.accessorMin.y, layout.accessorMin.z, layout.accessorMax.x, layout.accessorMax.y, layout.accessorMax.z);
+    appendFormat(json, "{\"bufferView\":0,\"byteOffset\":%zu,\"componentType\":%d,%s\"count\":%zu,\"type\":\"VEC3\"},",
+                 layout.normalOffset(), quantize ? GLTF_BYTE : GLTF_FLOAT, quantize ? "\"normalized\":true," : "", layout.vertexCount);
+    appendFormat(json, "{\"bufferView\":1,\"byteOffset\":0,\"componentType\":%d,\"count\":%zu,\"type\":\"SCALAR\"}]}",
+                 layout.shortIndices() ? GLTF_UNSIGNED_SHORT : GLTF_UNSIGNED_INT, layout.indexCount);
+    while (json.size() % 4)
+    {
+        json += ' ';
+    }
+    return json;
+}
+
+// GLB lengths are 32-bit. The JSON chunk is counted at its longest, so this holds before the bounds are known.
+static bool checkGlbSize(const GlbLayout &layout)
+{
+    if (12 + 8 + GLB_JSON_MAX_BYTES + 8 + layout.binaryBytes() > UINT32_MAX)
+    {
+        std::cerr << "Error: The mesh is too large for GLB, which is limited to 4 GiB; export it as PLY, STL or OBJ\n";
+        return false;
+    }
+    return true;
+}
+
+// Header: magic "glTF", version, total length; then the JSON chunk and the header of the BIN chunk
+static void writeGlbHeader(BufferedWriter &writer, const GlbLayout &layout)
+{
+    std::string json = formatGlbJson(layout);
+    char *header = writer.reserve(20);
+    header = putUInt32LE(header, 0x46546C67);
+    header = putUInt32LE(header, 2);
+    header = putUInt32LE(header, 12 + 8 + json.size() + 8 + layout.binaryBytes());
+    header = putUInt32LE(header, json.size());
+    writer.commit(putUInt32LE(header, 0x4E4F534A));
+    writer.write(json.data(), json.size());
+
+    header = writer.reserve(8);
+    header = putUInt32LE(header, layout.binaryBytes());
+    writer.commit(putUInt32LE(header, 0x004E4942));
+}
+
+bool exportToGlb(const ExportMesh &mesh, const std::string &filename, bool quantize, ExportProgress *progress)
+{
+    GlbLayout layout;
+    layout.quantize = quantize;
+    layout.vertexCount = mesh.vertexCount();
+    layout.indexCount = mesh.triangles.size();
+    if (!checkGlbSize(layout))
+    {
+        return false;
+    }
+
+    glm::vec3 lower(0.0f), upper(0.0f);
+    if (!mesh.positions.empty())
+    {
+        lower = upper = mesh.positions[0];
+        for (const auto &position : mesh.positions)
+        {
+            lower = glm::min(lower, position);
+            upper = glm::max(upper, position);
+        }
+    }
+    setGlbBounds(layout, lower, upper);
+
+    std::vector<char> binary(layout.binaryBytes(), 0);
+    layout.accessorMin = layout.accessorMax = glm::vec3(0.0f);
+    char *out = binary.data();
+    for (size_t v = 0; v < layout.vertexCount; ++v)
+    {
+        // the buffer is packed before the file is opened, so cancelling leaves nothing behind
+        if (v % EXPORT_PROGRESS_INTERVAL == 0 && !reportProgress(progress, 0.9f * v / layout.vertexCount))
+        {
+            return false;
+        }
+
+        glm::vec3 stored;
+        out = putGlbVertex(out, layout, mesh.positions[mesh.vertexPositions[v]], mesh.normals[mesh.vertexNormals[v]], stored);
+        layout.accessorMin = v == 0 ? stored : glm::min(layout.accessorMin, stored);
+        layout.accessorMax = v == 0 ? stored : glm::max(layout.accessorMax, stored);
+    }
+    for (size_t i = 0; i < layout.indexCount; ++i)
+    {
+        out = layout.shortIndices() ? putUInt16LE(out, mesh.triangles[i]) : putUInt32LE(out, mesh.triangles[i]);
+    }
+
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+
+    writeGlbHeader(writer, layout);
+    writer.write(binary.data(), binary.size());
+
+    reportProgress(progress, 1.0f);
+    return closeExport(writer, filename);
+}
+
+bool exportMesh(const ExportMesh &mesh, const std::string &filename, const ExportSettings &settings, ExportProgress *progress)
+{
+    switch (settings.format)
+    {
+    case EXPORT_STL:
+        return exportToStl(mesh, filename, progress);
+    case EXPORT_PLY:
+        return exportToPly(mesh, filename, progress);
+    case EXPORT_GLB:
+        return exportToGlb(mesh, filename, settings.quantize, progress);
+    default:
+        return exportToObj(mesh, filename, settings.precision, progress);
+    }
+}
+
+///=========================================================================================///
+///                                      Streamed Export
+///=========================================================================================///
+
+// Numbering of a streamed mesh. A vertex is a position/normal pair. The four front cap vertices come
+// first, then four per ribbon position (on the top, bottom and side strips), then the four end cap
+// vertices. Positions are the top and bottom vertex of each ribbon position. Both are numbered in the
+// order the ribbon positions arrive, so every record can be written as soon as its chunk is built.
+enum StreamSlot
+{
+    SLOT_TOP,
+    SLOT_BOTTOM,
+    SLOT_SIDE_TOP,
+    SLOT_SIDE_BOTTOM,
+    STREAM_SLOTS
+};
+
+#define STREAM_CAP_VERTICES 4
+#define STREAM_MAX_TRIANGLES 6 // triangles one ribbon position completes: four strips and a cap
+
+struct StreamLayout
+{
+    size_t ribbonSize;
+
+    size_t vertexCount() const { return STREAM_SLOTS * ribbonSize + 2 * STREAM_CAP_VERTICES; }
+    // four strips of ribbonSize - 2 triangles and two caps of two
+    size_t triangleCount() const { return 4 * ribbonSize - 4; }
+
+    unsigned int vertex(size_t k, int slot) const { return STREAM_CAP_VERTICES + STREAM_SLOTS * k + slot; }
+    unsigned int endVertex(int j) const { return STREAM_CAP_VERTICES + STREAM_SLOTS * ribbonSize + j; }
+
+    // Position of a vertex; top and bottom vertices alternate on both caps and the side strips
+    unsigned int position(unsigned int v) const
+    {
+        if (v < STREAM_CAP_VERTICES)
+        {
+            return v;
+        }
+        if (v >= endVertex(0))
+        {
+            // end cap: top and bottom of the last, then of the second last position
+            size_t j = v - endVertex(0);
+            return 2 * (ribbonSize - 1 - j / 2) + j % 2;
+        }
+        return 2 * ((v - STREAM_CAP_VERTICES) / STREAM_SLOTS) + (v - STREAM_CAP_VERTICES) % 2;
+    }
+
+    // Vertex at position p of each strip of extrudeSurface
+    unsigned int topStrip(size_t p) const { return vertex(p, SLOT_TOP); }
+    unsigned int bottomStrip(size_t p) const { return vertex(p, SLOT_BOTTOM); }
+    unsigned int side1Strip(size_t p) const { return vertex(p & ~(size_t)1, SLOT_SIDE_TOP + p % 2); }
+    unsigned int side2Strip(size_t p) const { return vertex((p & ~(size_t)1) + 1, SLOT_SIDE_TOP + p % 2); }
+    unsigned int frontStrip(size_t p) const { return p; }
+    unsigned int endStrip(size_t p) const { return endVertex(p); }
+
+    // Triangles whose last vertex belongs to ribbon position k; returns how many
+    int triangles(size_t k, unsigned int (*out)[3]) const;
+};
+
+// Triangle i of a strip, flipping every other one to keep the winding order as buildExportMesh does
+template <class Strip>
+static inline void stripTriangle(const StreamLayout &layout, Strip strip, size_t i, unsigned int *out)
+{
+    unsigned int v0 = (layout.*strip)(i), v1 = (layout.*strip)(i + 1), v2 = (layout.*strip)(i + 2);
+    out[0] = (i % 2 == 0) ? v0 : v2;
+    out[1] = v1;
+    out[2] = (i % 2 == 0) ? v2 : v0;
+}
+
+int StreamLayout::triangles(size_t k, unsigned int (*out)[3]) const
+{
+    int count = 0;
+    if (k >= 2)
+    {
+        stripTriangle(*this, &StreamLayout::topStrip, k - 2, out[count++]);
+        stripTriangle(*this, &StreamLayout::bottomStrip, k - 2, out[count++]);
+    }
+
+    // Side strip positions 2j and 2j + 1 belong to ribbon position 2j on SIDE1 and 2j + 1 on SIDE2;
+    // triangle i of a strip ends at position i + 2
+    size_t firstSide = k - k % 2;
+    for (size_t p = std::max<size_t>(firstSide, 2); p < firstSide + 2 && p < ribbonSize; ++p)
+    {
+        stripTriangle(*this, k % 2 == 0 ? &StreamLayout::side1Strip : &StreamLayout::side2Strip, p - 2, out[count++]);
+    }
+
+    if (k == 1)
+    {
+        stripTriangle(*this, &StreamLayout::frontStrip, 0, out[count++]);
+        stripTriangle(*this, &StreamLayout::frontStrip, 1, out[count++]);
+    }
+    if (k == ribbonSize - 1)
+    {
+        stripTriangle(*this, &StreamLayout::endStrip, 0, out[count++]);
+        stripTriangle(*this, &StreamLayout::endStrip, 1, out[count++]);
+    }
+    return count;
+}
+
+static inline const glm::vec3 &streamPosition(const ExtrudedMeshChunk &chunk, unsigned int position)
+{
+    return position % 2 == 0 ? chunk.top(position / 2) : chunk.bottom(position / 2);
+}
+
+// Vertices ribbon position k adds, in numbering order; returns how many
+static int streamVertices(const ExtrudedMeshChunk &chunk, const StreamLayout &layout, size_t k, glm::vec3 *positions, glm::vec3 *normals)
+{
+    int count = 0;
+    if (k == 0)
+    {
+        for (int j = 0; j < STREAM_CAP_VERTICES; ++j, ++count)
+        {
+            positions[count] = streamPosition(chunk, layout.position(j));
+            normals[count] = chunk.frontNormals()[j];
+        }
+    }
+
+    const glm::vec3 slotNormals[STREAM_SLOTS] = {chunk.topNormal(k), chunk.bottomNormal(k), chunk.sideTopNormal(k), chunk.sideBottomNormal(k)};
+    for (int slot = 0; slot < STREAM_SLOTS; ++slot, ++count)
+    {
+        positions[count] = slot % 2 == 0 ? chunk.top(k) : chunk.bottom(k);
+        normals[count] = slotNormals[slot];
+    }
+
+    if (k == layout.ribbonSize - 1)
+    {
+        for (int j = 0; j < STREAM_CAP_VERTICES; ++j, ++count)
+        {
+            positions[count] = streamPosition(chunk, layout.position(layout.endVertex(j)));
+            normals[count] = chunk.endNormals()[j];
+        }
+    }
+    return count;
+}
+
+#define STREAM_MAX_VERTICES (STREAM_SLOTS + 2 * STREAM_CAP_VERTICES)
+#define STREAM_OBJ_BLOCK 1024 // ribbon positions one task formats into its own block
+// longest text of one ribbon position: two v, its vn and its f records
+#define STREAM_OBJ_POSITION_MAX ((2 + STREAM_MAX_VERTICES + STREAM_MAX_TRIANGLES) * OBJ_LINE_MAX)
+
+// All records of ribbon position k. Its normals and positions are written before the faces that
+// complete at k, so every face only refers to records above it.
+static char *formatStreamObjPosition(char *out, const ExtrudedMeshChunk &chunk, const StreamLayout &layout, size_t k, int precision)
+{
+    glm::vec3 positions[STREAM_MAX_VERTICES], normals[STREAM_MAX_VERTICES];
+    int vertexCount = streamVertices(chunk, layout, k, positions, normals);
+
+    // the front cap normals come first in the numbering, before any position
+    int first = 0;
+    if (k == 0)
+    {
+        for (; first < STREAM_CAP_VERTICES; ++first)
+        {
+            out = formatObjVector(out, "vn", 2, normals[first], precision);
+        }
+    }
+    out = formatObjVector(out, "v", 1, chunk.top(k), precision);
+    out = formatObjVector(out, "v", 1, chunk.bottom(k), precision);
+    for (int v = first; v < vertexCount; ++v)
+    {
+        out = formatObjVector(out, "vn", 2, normals[v], precision);
+    }
+
+    unsigned int triangles[STREAM_MAX_TRIANGLES][3];
+    int triangleCount = layout.triangles(k, triangles);
+    for (int t = 0; t < triangleCount; ++t)
+    {
+        *out++ = 'f';
+        for (int c = 0; c < 3; ++c)
+        {
+            out = formatObjCorner(out, layout.position(triangles[t][c]), triangles[t][c]);
+        }
+        *out++ = '\n';
+    }
+    return out;
+}
+
+static bool exportStreamedObj(ExtrudedMeshStream &stream, const StreamLayout &layout, BufferedWriter &writer, int precision, ExportProgress *progress)
+{
+    std::vector<FormatBlock> blocks(OBJ_BATCH_BLOCKS * parallelThreadCount());
+    ExtrudedMeshChunk chunk;
+    while (stream.next(chunk))
+    {
+        size_t blockCount = (chunk.end - chunk.begin + STREAM_OBJ_BLOCK - 1) / STREAM_OBJ_BLOCK;
+        for (size_t first = 0; first < blockCount; first += blocks.size())
+        {
+            size_t count = std::min(blocks.size(), blockCount - first);
+            formatBlocksInOrder(writer, blocks, count, [&](size_t i, FormatBlock &block)
+                                {
+                                    size_t begin = chunk.begin + (first + i) * STREAM_OBJ_BLOCK;
+                                    size_t end = std::min(chunk.end, begin + STREAM_OBJ_BLOCK);
+                                    char *out = block.reserve((end - begin) * STREAM_OBJ_POSITION_MAX);
+                                    char *start = out;
+                                    for (size_t k = begin; k < end; ++k)
+                                    {
+                                        out = formatStreamObjPosition(out, chunk, layout, k, precision);
+                                    }
+                                    block.used = out - start;
+                                });
+        }
+
+        if (!reportProgress(progress, (float)chunk.end / layout.ribbonSize))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool exportStreamedStl(ExtrudedMeshStream &stream, const StreamLayout &layout, BufferedWriter &writer, ExportProgress *progress)
+{
+    writeStlHeader(writer, layout.triangleCount());
+
+    ExtrudedMeshChunk chunk;
+    while (stream.next(chunk))
+    {
+        for (size_t k = chunk.begin; k < chunk.end; ++k)
+        {
+            unsigned int triangles[STREAM_MAX_TRIANGLES][3];
+            int triangleCount = layout.triangles(k, triangles);
+            for (int t = 0; t < triangleCount; ++t)
+            {
+                glm::vec3 corners[3];
+                for (int c = 0; c < 3; ++c)
+                {
+                    corners[c] = streamPosition(chunk, layout.position(triangles[t][c]));
+                }
+                writeStlFacet(writer, corners);
+            }
+        }
+
+        if (!reportProgress(progress, (float)chunk.end / layout.ribbonSize))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool exportStreamedPly(ExtrudedMeshStream &stream, const StreamLayout &layout, BufferedWriter &writer, ExportProgress *progress)
+{
+    writePlyHeader(writer, layout.vertexCount(), layout.triangleCount());
+
+    // the vertices need the geometry; the faces only depend on the numbering
+    ExtrudedMeshChunk chunk;
+    while (stream.next(chunk))
+    {
+        for (size_t k = chunk.begin; k < chunk.end; ++k)
+        {
+            glm::vec3 positions[STREAM_MAX_VERTICES], normals[STREAM_MAX_VERTICES];
+            int vertexCount = streamVertices(chunk, layout, k, positions, normals);
+            for (int v = 0; v < vertexCount; ++v)
+            {
+                writePlyVertex(writer, positions[v], normals[v]);
+            }
+        }
+
+        if (!reportProgress(progress, 0.8f * chunk.end / layout.ribbonSize))
+        {
+            return false;
+        }
+    }
+
+    for (size_t k = 0; k < layout.ribbonSize; ++k)
+    {
+        unsigned int triangles[STREAM_MAX_TRIANGLES][3];
+        int triangleCount = layout.triangles(k, triangles);
+        for (int t = 0; t < triangleCount; ++t)
+        {
+            writePlyFace(writer, triangles[t]);
+        }
+    }
+    return reportProgress(progress, 1.0f);
+}
+
+// The counts of the GLB a stream writes; the bounds are only known after a pass over the curve
+static GlbLayout streamedGlbLayout(const StreamLayout &layout, bool quantize)
+{
+    GlbLayout glb;
+    glb.quantize = quantize;
+    glb.vertexCount = layout.vertexCount();
+    glb.indexCount = 3 * layout.triangleCount();
+    return glb;
+}
+
+static bool exportStreamedGlb(ExtrudedMeshStream &stream, const StreamLayout &layout, BufferedWriter &writer, bool quantize, ExportProgress *progress)
+{
+    // The header needs the bounds before the first vertex, so the curve is streamed twice
+    ExtrudedMeshChunk chunk;
+    glm::vec3 lower(0.0f), upper(0.0f);
+    while (stream.next(chunk))
+    {
+        for (size_t k = chunk.begin; k < chunk.end; ++k)
+        {
+            lower = k == 0 ? chunk.top(k) : glm::min(lower, chunk.top(k));
+            upper = k == 0 ? chunk.top(k) : glm::max(upper, chunk.top(k));
+            lower = glm::min(lower, chunk.bottom(k));
+            upper = glm::max(upper, chunk.bottom(k));
+        }
+
+        if (!reportProgress(progress, 0.4f * chunk.end / layout.ribbonSize))
+        {
+            return false;
+        }
+    }
+
+    GlbLayout glb = streamedGlbLayout(layout, quantize);
+    setGlbBounds(glb, lower, upper);
+    glb.accessorMin = lower;
+    glb.accessorMax = upper;
+    if (quantize)
+    {
+        // quantizing is monotonic, so the bounds of the stored positions are the quantized bounds
+        for (int i = 0; i < 3; ++i)
+        {
+            glb.accessorMin[i] = quantizeGlbCoordinate(glb, lower[i], i);
+            glb.accessorMax[i] = quantizeGlbCoordinate(glb, upper[i], i);
+        }
+    }
+    writeGlbHeader(writer, glb);
+
+    stream.rewind();
+    while (stream.next(chunk))
+    {
+        for (size_t k = chunk.begin; k < chunk.end; ++k)
+        {
+            glm::vec3 positions[STREAM_MAX_VERTICES], normals[STREAM_MAX_VERTICES];
+            int vertexCount = streamVertices(chunk, layout, k, positions, normals);
+            char *out = writer.reserve(STREAM_MAX_VERTICES * glb.stride());
+            for (int v = 0; v < vertexCount; ++v)
+            {
+                glm::vec3 stored;
+                out = putGlbVertex(out, glb, positions[v], normals[v], stored);
+            }
+            writer.commit(out);
+        }
+
+        if (!reportProgress(progress, 0.4f + 0.5f * chunk.end / layout.ribbonSize))
+        {
+            return false;
+        }
+    }
+
+    for (size_t k = 0; k < layout.ribbonSize; ++k)
+    {
+        unsigned int triangles[STREAM_MAX_TRIANGLES][3];
+        int triangleCount = layout.triangles(k, triangles);
+        char *out = writer.reserve(STREAM_MAX_TRIANGLES * 3 * 4);
+        for (int t = 0; t < triangleCount; ++t)
+        {
+            for (int c = 0; c < 3; ++c)
+            {
+                out = glb.shortIndices() ? putUInt16LE(out, triangles[t][c]) : putUInt32LE(out, triangles[t][c]);
+            }
+        }
+        writer.commit(out);
+    }
+
+    char *out = writer.reserve(4);
+    size_t padding = glb.binaryBytes() - glb.vertexBytes() - glb.indexBytes();
+    memset(out, 0, padding);
+    writer.commit(out + padding);
+    return reportProgress(progress, 1.0f);
+}
+
+bool exportStreamed(const HarmonographParams &params, float animationTime, float step, const std::string &filename, const ExportSettings &settings, ExportProgress *progress)
+{
+    ExtrudedMeshStream stream(params, animationTime, step);
+    StreamLayout layout = {stream.ribbonSize()};
+    if (layout.ribbonSize == 0)
+    {
+        std::cerr << "Error: The curve is too short to extrude\n";
+        return false;
+    }
+    if (layout.vertexCount() > UINT_MAX)
+    {
+        std::cerr << "Error: The curve has too many samples to export\n";
+        return false;
+    }
+    if (settings.format == EXPORT_GLB && !checkGlbSize(streamedGlbLayout(layout, settings.quantize)))
+    {
+        return false;
+    }
+
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+
+    bool success;
+    switch (settings.format)
+    {
+    case EXPORT_STL:
+        success = exportStreamedStl(stream, layout, writer, progress);
+        break;
+    case EXPORT_PLY:
+        success = exportStreamedPly(stream, layout, writer, progress);
+        break;
+    case EXPORT_GLB:
+        success = exportStreamedGlb(stream, layout, writer, settings.quantize, progress);
+        break;
+    default:
+        success = exportStreamedObj(stream, layout, writer, settings.precision, progress);
+        break;
+    }
+
+    if (!success)
+    {
+        return abortExport(writer, filename);
+    }
+    return closeExport(writer, filename);
+}
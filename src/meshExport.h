@@ -0,0 +1,111 @@
+#ifndef MESHEXPORT_H
+#define MESHEXPORT_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+
+#define EXPORT_VERTEX_CACHE_SIZE 16 // post-transform cache size the triangle order is tuned for
+#define OBJ_DEFAULT_PRECISION 6     // decimals written for OBJ coordinates
+
+// Indexed triangle mesh prepared for export. Positions and normals are indexed separately, as in
+// OBJ; a vertex is a (position, normal) pair.
+struct ExportMesh
+{
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<unsigned int> vertexPositions; // position index of each vertex
+    std::vector<unsigned int> vertexNormals;   // normal index of each vertex
+    std::vector<unsigned int> triangles;       // three vertex indices per triangle, counter-clockwise
+
+    size_t vertexCount() const { return vertexPositions.size(); }
+    size_t triangleCount() const { return triangles.size() / 3; }
+};
+
+// Progress of an export running on another thread, and its cancel request
+struct ExportProgress
+{
+    std::atomic<float> fraction;
+    std::atomic<bool> cancelled;
+    float stageBegin, stageSize; // part of the whole export the current stage covers
+
+    ExportProgress() : fraction(0.0f), cancelled(false), stageBegin(0.0f), stageSize(1.0f) {}
+
+    void beginStage(float begin, float size)
+    {
+        stageBegin = begin;
+        stageSize = size;
+        fraction = begin;
+    }
+
+    // Report how far the current stage is; returns false once the export has been cancelled
+    bool report(float stageFraction)
+    {
+        fraction = stageBegin + stageSize * stageFraction;
+        return !cancelled;
+    }
+};
+
+inline bool reportProgress(ExportProgress *progress, float stageFraction)
+{
+    return !progress || progress->report(stageFraction);
+}
+
+// Turn the strips of the extruded mesh into a triangle list. With optimize set, identical positions,
+// normals and vertices are welded, triangles are reordered for the post-transform vertex cache and
+// vertices, positions and normals are renumbered in the order the triangles first use them.
+// Returns false if the export was cancelled.
+bool buildExportMesh(const ExtrudedMesh &mesh, ExportMesh &out, bool optimize = true, ExportProgress *progress = nullptr);
+
+// Reorder triangles for a vertex cache of cacheSize entries (Tipsify, Sander et al. 2007)
+void optimizeVertexCache(std::vector<unsigned int> &triangles, size_t vertexCount, unsigned int cacheSize = EXPORT_VERTEX_CACHE_SIZE);
+
+enum ExportFormat
+{
+    EXPORT_OBJ,
+    EXPORT_STL,
+    EXPORT_PLY,
+    EXPORT_GLB,
+    EXPORT_FORMAT_COUNT
+};
+
+extern const char *exportFormatNames[EXPORT_FORMAT_COUNT];
+extern const char *exportFormatExtensions[EXPORT_FORMAT_COUNT];
+
+struct ExportSettings
+{
+    ExportFormat format;
+    bool optimize; // weld and reorder in buildExportMesh
+    int precision; // OBJ decimals
+    bool quantize; // GLB: 16-bit positions and 8-bit normals (KHR_mesh_quantization)
+};
+
+// The writers report errors on stderr and return false when the file could not be written.
+// A cancelled export stops early and removes the partial file.
+
+// Write the mesh as OBJ text with at most precision decimals per coordinate
+bool exportToObj(const ExportMesh &mesh, const std::string &filename, int precision = OBJ_DEFAULT_PRECISION, ExportProgress *progress = nullptr);
+
+// Binary STL: one facet per triangle, facet normals from the triangle winding
+bool exportToStl(const ExportMesh &mesh, const std::string &filename, ExportProgress *progress = nullptr);
+
+// Little-endian binary PLY with per-vertex positions and normals
+bool exportToPly(const ExportMesh &mesh, const std::string &filename, ExportProgress *progress = nullptr);
+
+// glTF 2.0 binary with one interleaved position/normal buffer, optionally quantized
+bool exportToGlb(const ExportMesh &mesh, const std::string &filename, bool quantize = false, ExportProgress *progress = nullptr);
+
+// Write the mesh in the format chosen in settings
+bool exportMesh(const ExportMesh &mesh, const std::string &filename, const ExportSettings &settings, ExportProgress *progress = nullptr);
+
+// Evaluate, extrude and write the curve chunk by chunk with an ExtrudedMeshStream, so memory use does
+// not grow with the length of the curve. Global vertex numbers are worked out as the chunks arrive.
+// The file holds the same triangles, positions and normals as an export of buildExportMesh without
+// optimize, in a different order; welding needs the whole mesh, so settings.optimize is ignored.
+bool exportStreamed(const HarmonographParams &params, float animationTime, float step, const std::string &filename, const ExportSettings &settings, ExportProgress *progress = nullptr);
+
+#endif //MESHEXPORT_H
@@ -0,0 +1,146 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "traceRecorder.h"
+
+namespace
+{
+
+class ThreadPool
+{
+public:
+    ThreadPool()
+        : task(nullptr), count(0), next(0), active(0), generation(0), stopping(false)
+    {
+        unsigned int threads = std::thread::hardware_concurrency();
+        for (unsigned int i = 1; i < threads; ++i)
+        {
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            workers[i].join();
+        }
+    }
+
+    unsigned int threadCount() const { return workers.size() + 1; }
+
+    void run(size_t taskCount, const std::function<void(size_t)> &taskFunction)
+    {
+        std::unique_lock<std::mutex> runLock(runMutex, std::try_to_lock);
+        if (!runLock.owns_lock() || workers.empty() || taskCount < 2)
+        {
+            for (size_t i = 0; i < taskCount; ++i)
+            {
+                taskFunction(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task = &taskFunction;
+            count = taskCount;
+            next = 0;
+            active = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        drain();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]
+                  { return active == 0; });
+        task = nullptr;
+    }
+
+private:
+    void drain()
+    {
+        for (;;)
+        {
+            size_t i = next.fetch_add(1);
+            if (i >= count)
+            {
+                break;
+            }
+            (*task)(i);
+        }
+    }
+
+    void workerLoop()
+    {
+        traceRecorder.setThreadName("Worker");
+        unsigned long seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen]
+                          { return stopping || generation != seen; });
+                if (stopping)
+                {
+                    return;
+                }
+                seen = generation;
+            }
+
+            {
+                TRACE_SCOPE("Parallel tasks");
+                drain();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0)
+            {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex runMutex; // one parallelFor at a time
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(size_t)> *task;
+    size_t count;
+    std::atomic<size_t> next;
+    size_t active;
+    unsigned long generation;
+    bool stopping;
+};
+
+ThreadPool &threadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+}
+
+unsigned int parallelThreadCount()
+{
+    return threadPool().threadCount();
+}
+
+void parallelFor(size_t count, const std::function<void(size_t)> &task)
+{
+    threadPool().run(count, task);
+}
@@ -0,0 +1,15 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Number of threads parallelFor runs on, including the calling thread
+unsigned int parallelThreadCount();
+
+// Run task(i) for every i in [0, count) on a persistent pool of worker threads and the calling
+// thread, and return once all of them have finished. If the pool is already busy with another
+// thread's work the tasks run on the calling thread instead. Tasks must not call parallelFor.
+void parallelFor(size_t count, const std::function<void(size_t)> &task);
+
+#endif //PARALLEL_H
@@ -0,0 +1,292 @@
+#include "plotExport.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <utility>
+
+#include "bufferedWriter.h"
+
+///=========================================================================================///
+///                                   Path Simplification
+///=========================================================================================///
+
+// Squared distance from p to the segment a-b
+static inline float segmentDistance2(const glm::vec2 &p, const glm::vec2 &a, const glm::vec2 &b)
+{
+    glm::vec2 ab = b - a;
+    float length2 = glm::dot(ab, ab);
+    float t = length2 > 0.0f ? glm::clamp(glm::dot(p - a, ab) / length2, 0.0f, 1.0f) : 0.0f;
+    glm::vec2 d = p - (a + t * ab);
+    return glm::dot(d, d);
+}
+
+void simplifyPolyline(const glm::vec2 *points, size_t count, float tolerance, std::vector<size_t> &kept)
+{
+    kept.clear();
+    std::vector<bool> keep(count, count < 3);
+    if (count >= 3)
+    {
+        keep[0] = keep[count - 1] = true;
+    }
+
+    // Split at the furthest point until every span is within tolerance. An explicit stack instead of
+    // recursion, since a span can be split many times over a long curve. The distance is measured to
+    // the segment rather than the line, as the curve often returns to where a span started.
+    float tolerance2 = tolerance * tolerance;
+    std::vector<std::pair<size_t, size_t>> spans;
+    if (count >= 3)
+    {
+        spans.push_back(std::make_pair((size_t)0, count - 1));
+    }
+    while (!spans.empty())
+    {
+        size_t first = spans.back().first;
+        size_t last = spans.back().second;
+        spans.pop_back();
+
+        float furthest2 = 0.0f;
+        size_t furthest = first;
+        for (size_t i = first + 1; i < last; ++i)
+        {
+            float distance2 = segmentDistance2(points[i], points[first], points[last]);
+            if (distance2 > furthest2)
+            {
+                furthest2 = distance2;
+                furthest = i;
+            }
+        }
+
+        if (furthest2 > tolerance2)
+        {
+            keep[furthest] = true;
+            spans.push_back(std::make_pair(first, furthest));
+            spans.push_back(std::make_pair(furthest, last));
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (keep[i])
+        {
+            kept.push_back(i);
+        }
+    }
+}
+
+static inline PlotPoint toPlotUnits(const glm::vec2 &point)
+{
+    const float scale = (float)std::pow(10.0, PLOT_DECIMALS);
+    PlotPoint p = {(int32_t)std::lround(point.x * scale), (int32_t)std::lround(point.y * scale)};
+    return p;
+}
+
+void buildPlotPath(const glm::vec2 *points, const size_t *indices, size_t count, PlotPath &path)
+{
+    path.moves.clear();
+    if (count == 0)
+    {
+        path.start.x = path.start.y = 0;
+        return;
+    }
+
+    path.start = toPlotUnits(points[indices[0]]);
+    PlotPoint position = path.start;
+    for (size_t i = 1; i < count; ++i)
+    {
+        PlotPoint next = toPlotUnits(points[indices[i]]);
+        PlotPoint move = {next.x - position.x, next.y - position.y};
+        if (move.x == 0 && move.y == 0)
+        {
+            continue;
+        }
+        position = next;
+
+        // Collinear with the previous move and in the same direction: extend it
+        if (!path.moves.empty())
+        {
+            PlotPoint &previous = path.moves.back();
+            int64_t cross = (int64_t)previous.x * move.y - (int64_t)previous.y * move.x;
+            int64_t dot = (int64_t)previous.x * move.x + (int64_t)previous.y * move.y;
+            if (cross == 0 && dot > 0)
+            {
+                previous.x += move.x;
+                previous.y += move.y;
+                continue;
+            }
+        }
+        path.moves.push_back(move);
+    }
+}
+
+///=========================================================================================///
+///                                       Plot Export
+///=========================================================================================///
+
+const char *plotFormatNames[PLOT_FORMAT_COUNT] = {"G-code", "SVG"};
+const char *plotFormatExtensions[PLOT_FORMAT_COUNT] = {"gcode", "svg"};
+
+#define PLOT_MOVE_MAX (2 * (FORMAT_FIXED_MAX + 2) + 1) // longest text of one move in either format
+
+// Relative moves with the modal G1 of the first one; axes that do not move are left out
+static void writeGcode(BufferedWriter &writer, const PlotPath &path, const PlotSettings &settings)
+{
+    char header[256];
+    int headerSize = snprintf(header, sizeof(header),
+                              "; Harmonograph plot, %zu moves\n"
+                              "G21\n"
+                              "G90\n"
+                              "%s\n",
+                              path.moves.size(), PLOT_PEN_UP);
+    writer.write(header, headerSize);
+
+    char *out = writer.reserve(PLOT_MOVE_MAX + 32);
+    out += snprintf(out, 8, "G0 X");
+    out = formatFixed(out, path.start.x, PLOT_DECIMALS);
+    *out++ = ' ';
+    *out++ = 'Y';
+    out = formatFixed(out, path.start.y, PLOT_DECIMALS);
+    *out++ = '\n';
+    writer.commit(out);
+
+    headerSize = snprintf(header, sizeof(header), "%s\nG91\nG1 F%d", PLOT_PEN_DOWN, settings.feedRate);
+    writer.write(header, headerSize);
+
+    // the first move continues the G1 line
+    char separator = ' ';
+    for (const auto &move : path.moves)
+    {
+        out = writer.reserve(PLOT_MOVE_MAX);
+        *out++ = separator;
+        if (move.x != 0)
+        {
+            *out++ = 'X';
+            out = formatFixed(out, move.x, PLOT_DECIMALS);
+        }
+        if (move.y != 0)
+        {
+            if (move.x != 0)
+            {
+                *out++ = ' ';
+            }
+            *out++ = 'Y';
+            out = formatFixed(out, move.y, PLOT_DECIMALS);
+        }
+        writer.commit(out);
+        separator = '\n';
+    }
+
+    headerSize = snprintf(header, sizeof(header), "\n%s\nG90\n", PLOT_PEN_UP);
+    writer.write(header, headerSize);
+}
+
+#define SVG_MOVES_PER_LINE 8
+
+// One path of relative lineto commands; a minus sign separates numbers on its own
+static void writeSvg(BufferedWriter &writer, const PlotPath &path, const PlotSettings &settings)
+{
+    char header[512];
+    int headerSize = snprintf(header, sizeof(header),
+                              "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                              "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%gmm\" height=\"%gmm\" viewBox=\"0 0 %g %g\">\n"
+                              "<path fill=\"none\" stroke=\"black\" stroke-width=\"0.3\" stroke-linecap=\"round\" stroke-linejoin=\"round\" d=\"M",
+                              settings.width, settings.height, settings.width, settings.height);
+    writer.write(header, headerSize);
+
+    // SVG y points down the page
+    const int32_t height = toPlotUnits(glm::vec2(0.0f, settings.height)).y;
+    char *out = writer.reserve(PLOT_MOVE_MAX + 2);
+    out = formatFixed(out, path.start.x, PLOT_DECIMALS);
+    *out++ = ' ';
+    out = formatFixed(out, height - path.start.y, PLOT_DECIMALS);
+    *out++ = 'l';
+    writer.commit(out);
+
+    for (size_t i = 0; i < path.moves.size(); ++i)
+    {
+        out = writer.reserve(PLOT_MOVE_MAX + 1);
+        if (i > 0 && i % SVG_MOVES_PER_LINE == 0)
+        {
+            *out++ = '\n';
+        }
+        else if (i > 0 && path.moves[i].x >= 0)
+        {
+            *out++ = ' ';
+        }
+        out = formatFixed(out, path.moves[i].x, PLOT_DECIMALS);
+        if (path.moves[i].y <= 0)
+        {
+            *out++ = ' ';
+        }
+        out = formatFixed(out, -path.moves[i].y, PLOT_DECIMALS);
+        writer.commit(out);
+    }
+
+    const char footer[] = "\"/>\n</svg>\n";
+    writer.write(footer, sizeof(footer) - 1);
+}
+
+bool exportPlot(const HarmonographParams &params, float animationTime, float step, const std::string &filename, const PlotSettings &settings, size_t *moveCount)
+{
+    size_t count = harmonographSampleCount(animationTime, step);
+    if (count < 2)
+    {
+        std::cerr << "Error: The curve is too short to plot\n";
+        return false;
+    }
+
+    // Project onto the xy plane and fit to the paper inside the margins, keeping the aspect ratio
+    std::vector<glm::vec2> points(count);
+    {
+        std::vector<glm::vec3> samples(count);
+        evaluateHarmonograph(params, step, count, samples.data());
+        glm::vec2 lower(samples[0]), upper(samples[0]);
+        for (size_t i = 0; i < count; ++i)
+        {
+            points[i] = glm::vec2(samples[i]);
+            lower = glm::min(lower, points[i]);
+            upper = glm::max(upper, points[i]);
+        }
+
+        glm::vec2 extent = glm::max(upper - lower, glm::vec2(1e-6f));
+        glm::vec2 area = glm::max(glm::vec2(settings.width, settings.height) - 2.0f * settings.margin, glm::vec2(0.0f));
+        float scale = std::min(area.x / extent.x, area.y / extent.y);
+        glm::vec2 offset = 0.5f * glm::vec2(settings.width, settings.height) - scale * 0.5f * (lower + upper);
+        for (auto &point : points)
+        {
+            point = scale * point + offset;
+        }
+    }
+
+    std::vector<size_t> kept;
+    simplifyPolyline(points.data(), count, settings.tolerance, kept);
+    PlotPath path;
+    buildPlotPath(points.data(), kept.data(), kept.size(), path);
+
+    BufferedWriter writer;
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Unable to open file " << filename << " for writing\n";
+        return false;
+    }
+    if (settings.format == PLOT_SVG)
+    {
+        writeSvg(writer, path, settings);
+    }
+    else
+    {
+        writeGcode(writer, path, settings);
+    }
+    if (!writer.close())
+    {
+        std::cerr << "Error: Failed writing " << filename << "\n";
+        return false;
+    }
+
+    if (moveCount)
+    {
+        *moveCount = path.moves.size();
+    }
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef PLOTEXPORT_H
+#define PLOTEXPORT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "geometry.h"
+
+#define PLOT_DECIMALS 2              // coordinates are written in steps of 0.01 mm
+#define PLOT_DEFAULT_TOLERANCE 0.05f // mm the plotted path may deviate from the curve
+#define PLOT_DEFAULT_FEED_RATE 3000  // G-code drawing speed in mm/min
+#define PLOT_DEFAULT_WIDTH 210.0f    // A4 portrait, in mm
+#define PLOT_DEFAULT_HEIGHT 297.0f
+#define PLOT_DEFAULT_MARGIN 10.0f
+#define PLOT_PEN_DOWN "M3 S90"       // G-code that lowers the pen (servo pen lift)
+#define PLOT_PEN_UP "M5"             // G-code that raises the pen
+
+/******************************************************************************/
+/*****************************   Path Simplification **************************/
+/******************************************************************************/
+
+// Indices of the points Ramer-Douglas-Peucker keeps so that no dropped point is further than
+// tolerance from the simplified polyline. The first and last point are always kept.
+void simplifyPolyline(const glm::vec2 *points, size_t count, float tolerance, std::vector<size_t> &kept);
+
+// Position or move in plot units (10^-PLOT_DECIMALS mm)
+struct PlotPoint
+{
+    int32_t x, y;
+};
+
+// A pen-down path: the start and the relative moves from there. Positions are whole plot units, so
+// the relative moves add up exactly.
+struct PlotPath
+{
+    PlotPoint start;
+    std::vector<PlotPoint> moves;
+};
+
+// Round the points to plot units and drop moves that vanish or continue the previous one in the
+// same direction
+void buildPlotPath(const glm::vec2 *points, const size_t *indices, size_t count, PlotPath &path);
+
+/******************************************************************************/
+/*********************************   Plot Export ******************************/
+/******************************************************************************/
+
+enum PlotFormat
+{
+    PLOT_GCODE,
+    PLOT_SVG,
+    PLOT_FORMAT_COUNT
+};
+
+extern const char *plotFormatNames[PLOT_FORMAT_COUNT];
+extern const char *plotFormatExtensions[PLOT_FORMAT_COUNT];
+
+struct PlotSettings
+{
+    PlotFormat format;
+    float width, height; // paper in mm
+    float margin;        // mm kept free on every side
+    float tolerance;     // mm the simplified path may deviate from the curve
+    int feedRate;        // G-code drawing speed in mm/min
+};
+
+// Evaluate the curve, project it onto the xy plane, fit it to the paper and write it as one simplified
+// pen-down path. moveCount, if given, receives the number of moves written. Returns false and
+// reports on stderr when the file could not be written.
+bool exportPlot(const HarmonographParams &params, float animationTime, float step, const std::string &filename, const PlotSettings &settings, size_t *moveCount = nullptr);
+
+#endif //PLOTEXPORT_H
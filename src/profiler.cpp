@@ -0,0 +1,80 @@
+#include "profiler.h"
+
+///=========================================================================================///
+///                                       Frame Profiler
+///=========================================================================================///
+
+const char *profileStageNames[PROFILE_STAGE_COUNT] = {"Input", "Evaluate", "Normals", "Extrude", "Upload", "Draw", "Post", "ImGui", "Swap", "Other"};
+
+FrameProfiler frameProfiler;
+
+thread_local bool FrameProfiler::inFrame = false;
+
+FrameProfiler::FrameProfiler() : frames(), current(0), completed(0), active(PROFILE_OTHER), enabled(false)
+{
+}
+
+void FrameProfiler::beginFrame()
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    ProfileFrame &frame = frames[current % PROFILER_HISTORY];
+    frame.number = current;
+    frame.frameTime = 0.0f;
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+    {
+        frame.cpu[s] = 0.0f;
+        frame.gpu[s] = -1.0f;
+    }
+
+    active = PROFILE_OTHER;
+    frameStart = since = Clock::now();
+    inFrame = true;
+}
+
+void FrameProfiler::endFrame()
+{
+    if (!inFrame)
+    {
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    charge(now);
+    frames[current % PROFILER_HISTORY].frameTime = std::chrono::duration<float>(now - frameStart).count();
+    inFrame = false;
+    ++current;
+    ++completed;
+}
+
+void FrameProfiler::setGpuTime(uint64_t frameNumber, ProfileStage stage, float seconds)
+{
+    ProfileFrame &frame = frames[frameNumber % PROFILER_HISTORY];
+    if (frame.number == frameNumber)
+    {
+        frame.gpu[stage] = seconds;
+    }
+}
+
+void FrameProfiler::charge(Clock::time_point now)
+{
+    frames[current % PROFILER_HISTORY].cpu[active] += std::chrono::duration<float>(now - since).count();
+    since = now;
+}
+
+ProfileStage FrameProfiler::enter(ProfileStage stage)
+{
+    charge(Clock::now());
+    ProfileStage previous = active;
+    active = stage;
+    return previous;
+}
+
+void FrameProfiler::leave(ProfileStage previous)
+{
+    charge(Clock::now());
+    active = previous;
+}
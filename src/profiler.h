@@ -0,0 +1,133 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "traceRecorder.h"
+
+#define PROFILER_HISTORY 256 // frames kept for the overlay
+
+/******************************************************************************/
+/*******************************   Frame Profiler *****************************/
+/******************************************************************************/
+
+// Stages of a frame. Scopes do not overlap in the totals: time spent in a nested scope counts for the
+// inner stage only, and time outside every scope counts as PROFILE_OTHER.
+enum ProfileStage
+{
+    PROFILE_INPUT,    // processInput and glfwPollEvents
+    PROFILE_EVALUATE, // curve samples and ribbon edges
+    PROFILE_NORMALS,  // ribbon and strip normals
+    PROFILE_EXTRUDE,  // extruded vertices and strip indices
+    PROFILE_UPLOAD,   // writing vertex buffers
+    PROFILE_DRAW,     // draw calls of the curve and the mesh
+    PROFILE_POST,     // resolving, anti-aliasing and scaling the offscreen scene to the window
+    PROFILE_IMGUI,    // building and rendering the UI
+    PROFILE_SWAP,     // glfwSwapBuffers, including waiting for vsync
+    PROFILE_OTHER,
+    PROFILE_STAGE_COUNT
+};
+
+extern const char *profileStageNames[PROFILE_STAGE_COUNT];
+
+struct ProfileFrame
+{
+    uint64_t number;
+    float frameTime;                // seconds from beginFrame to endFrame
+    float cpu[PROFILE_STAGE_COUNT]; // seconds
+    float gpu[PROFILE_STAGE_COUNT]; // seconds; negative while the GPU result is outstanding or was never measured
+};
+
+// Per-stage CPU times of the render thread, kept for the last PROFILER_HISTORY frames. Only the thread
+// that called beginFrame is timed, so geometry code shared with worker threads can be instrumented.
+class FrameProfiler
+{
+public:
+    FrameProfiler();
+
+    void setEnabled(bool enable) { enabled = enable; }
+    bool isEnabled() const { return enabled; }
+
+    void beginFrame();
+    void endFrame();
+
+    // Number of the frame in progress
+    uint64_t frameNumber() const { return current; }
+    size_t frameCount() const { return completed < PROFILER_HISTORY ? (size_t)completed : PROFILER_HISTORY; }
+    // A completed frame; age 0 is the newest
+    const ProfileFrame &frame(size_t age) const { return frames[(current - 1 - age) % PROFILER_HISTORY]; }
+
+    // GPU results arrive a few frames late; frames that have left the history are ignored
+    void setGpuTime(uint64_t frameNumber, ProfileStage stage, float seconds);
+
+    // Used by ProfileScope
+    // Other threads never touch the frame state: the flag is set on the thread inside beginFrame/endFrame
+    bool profilesThisThread() const { return inFrame; }
+    ProfileStage activeStage() const { return active; }
+    ProfileStage enter(ProfileStage stage);
+    void leave(ProfileStage previous);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    FrameProfiler(const FrameProfiler &);
+    FrameProfiler &operator=(const FrameProfiler &);
+
+    void charge(Clock::time_point now);
+
+    ProfileFrame frames[PROFILER_HISTORY];
+    uint64_t current, completed;
+    Clock::time_point frameStart, since; // since: when the active stage was entered or resumed
+    ProfileStage active;
+    bool enabled;
+    static thread_local bool inFrame;
+};
+
+extern FrameProfiler frameProfiler;
+
+// Times the rest of the enclosing block as stage, and records it as a trace event on any thread while
+// a trace is recording
+class ProfileScope
+{
+public:
+    explicit ProfileScope(ProfileStage stage)
+        : active(frameProfiler.profilesThisThread()), stage(stage), previous(PROFILE_OTHER), traceStart(traceRecorder.isRecording() ? traceClock() : 0)
+    {
+        if (active)
+        {
+            previous = frameProfiler.enter(stage);
+        }
+    }
+    ~ProfileScope() { stop(); }
+
+    // End the scope before the end of its block
+    void stop()
+    {
+        if (active)
+        {
+            frameProfiler.leave(previous);
+            active = false;
+        }
+        if (traceStart)
+        {
+            traceRecorder.record(profileStageNames[stage], traceStart, traceClock());
+            traceStart = 0;
+        }
+    }
+
+private:
+    ProfileScope(const ProfileScope &);
+    ProfileScope &operator=(const ProfileScope &);
+
+    bool active;
+    ProfileStage stage, previous;
+    uint64_t traceStart;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(stage)
+
+#endif //PROFILER_H
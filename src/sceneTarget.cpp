@@ -0,0 +1,300 @@
+#include "sceneTarget.h"
+
+#include <iostream>
+
+#include <glad/glad.h>
+
+///=========================================================================================///
+///                                       Upscale Shader
+///=========================================================================================///
+
+// One triangle covering the window, from the vertex index alone
+static const char *upscaleVertexShaderSource =
+    "#version 330\n"
+    "out vec2 uv;\n"
+    "void main()\n"
+    "{\n"
+    "    uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+    "    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);\n"
+    "}\n";
+
+// Bilinear, plus an unsharp mask over the four neighbouring scene texels to win back some of the
+// edge contrast the upscale blurs away
+static const char *upscaleFragmentShaderSource =
+    "#version 330\n"
+    "uniform sampler2D scene;\n"
+    "uniform float sharpness;\n"
+    "in vec2 uv;\n"
+    "out vec4 Fragment;\n"
+    "void main()\n"
+    "{\n"
+    "    vec3 color = texture(scene, uv).rgb;\n"
+    "    if (sharpness > 0.0)\n"
+    "    {\n"
+    "        vec2 texel = 1.0 / vec2(textureSize(scene, 0));\n"
+    "        vec3 around = texture(scene, uv + vec2(texel.x, 0.0)).rgb + texture(scene, uv - vec2(texel.x, 0.0)).rgb +\n"
+    "                      texture(scene, uv + vec2(0.0, texel.y)).rgb + texture(scene, uv - vec2(0.0, texel.y)).rgb;\n"
+    "        color = clamp(color + sharpness * (color - 0.25 * around), 0.0, 1.0);\n"
+    "    }\n"
+    "    Fragment = vec4(color, 1.0);\n"
+    "}\n";
+
+// FXAA in the spirit of Lottes' console version: blend along the edge direction found from the luma of
+// the four diagonal neighbours, and fall back to the narrower blend where the wider one overshoots
+static const char *fxaaFragmentShaderSource =
+    "#version 330\n"
+    "uniform sampler2D scene;\n"
+    "in vec2 uv;\n"
+    "out vec4 Fragment;\n"
+    "const vec3 luma = vec3(0.299, 0.587, 0.114);\n"
+    "const float reduceMin = 1.0 / 128.0;\n"
+    "const float reduceMul = 1.0 / 8.0;\n"
+    "const float spanMax = 8.0;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 texel = 1.0 / vec2(textureSize(scene, 0));\n"
+    "    vec3 rgbM = texture(scene, uv).rgb;\n"
+    "    float lumaNW = dot(texture(scene, uv + vec2(-1.0, -1.0) * texel).rgb, luma);\n"
+    "    float lumaNE = dot(texture(scene, uv + vec2(1.0, -1.0) * texel).rgb, luma);\n"
+    "    float lumaSW = dot(texture(scene, uv + vec2(-1.0, 1.0) * texel).rgb, luma);\n"
+    "    float lumaSE = dot(texture(scene, uv + vec2(1.0, 1.0) * texel).rgb, luma);\n"
+    "    float lumaM = dot(rgbM, luma);\n"
+    "    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));\n"
+    "    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));\n"
+    "    vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));\n"
+    "    float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * reduceMul, reduceMin);\n"
+    "    float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);\n"
+    "    dir = clamp(dir * rcpDirMin, vec2(-spanMax), vec2(spanMax)) * texel;\n"
+    "    vec3 rgbA = 0.5 * (texture(scene, uv + dir * (1.0 / 3.0 - 0.5)).rgb + texture(scene, uv + dir * (2.0 / 3.0 - 0.5)).rgb);\n"
+    "    vec3 rgbB = 0.5 * rgbA + 0.25 * (texture(scene, uv - 0.5 * dir).rgb + texture(scene, uv + 0.5 * dir).rgb);\n"
+    "    float lumaB = dot(rgbB, luma);\n"
+    "    Fragment = vec4(lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB, 1.0);\n"
+    "}\n";
+
+static unsigned int compileShader(GLenum type, const char *source)
+{
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    int success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[512];
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cerr << "Error: Scene shader compilation failed\n"
+                  << infoLog << std::endl;
+    }
+    return shader;
+}
+
+static unsigned int linkProgram(const char *vertexSource, const char *fragmentSource)
+{
+    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    unsigned int fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    int success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[512];
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cerr << "Error: Scene shader linking failed\n"
+                  << infoLog << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+///=========================================================================================///
+///                                        Scene Target
+///=========================================================================================///
+
+const char *antiAliasingNames[AA_MODE_COUNT] = {"None", "MSAA 2x", "MSAA 4x", "MSAA 8x", "FXAA"};
+
+int antiAliasingSamples(AntiAliasing mode)
+{
+    switch (mode)
+    {
+    case AA_MSAA_2X:
+        return 2;
+    case AA_MSAA_4X:
+        return 4;
+    case AA_MSAA_8X:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+SceneTarget::SceneTarget()
+    : framebuffer(0), colorTexture(0), depthBuffer(0), multisampleFramebuffer(0), multisampleColor(0), multisampleDepth(0), upscaleProgram(0),
+      fxaaProgram(0), emptyVAO(0), sharpnessLoc(-1), targetWidth(0), targetHeight(0), targetSamples(0), requestedSamples(0), complete(false)
+{
+}
+
+bool SceneTarget::create()
+{
+    upscaleProgram = linkProgram(upscaleVertexShaderSource, upscaleFragmentShaderSource);
+    fxaaProgram = linkProgram(upscaleVertexShaderSource, fxaaFragmentShaderSource);
+    if (!upscaleProgram || !fxaaProgram)
+    {
+        destroy();
+        return false;
+    }
+    sharpnessLoc = glGetUniformLocation(upscaleProgram, "sharpness");
+
+    // The core profile draws nothing without a vertex array, even one without attributes
+    glGenVertexArrays(1, &emptyVAO);
+    return true;
+}
+
+void SceneTarget::destroy()
+{
+    release();
+    glDeleteProgram(upscaleProgram);
+    glDeleteProgram(fxaaProgram);
+    if (emptyVAO)
+    {
+        glDeleteVertexArrays(1, &emptyVAO);
+    }
+    upscaleProgram = fxaaProgram = emptyVAO = 0;
+}
+
+void SceneTarget::release()
+{
+    if (framebuffer)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &colorTexture);
+        framebuffer = colorTexture = 0;
+    }
+    if (depthBuffer)
+    {
+        glDeleteRenderbuffers(1, &depthBuffer);
+        depthBuffer = 0;
+    }
+    if (multisampleFramebuffer)
+    {
+        glDeleteFramebuffers(1, &multisampleFramebuffer);
+        glDeleteRenderbuffers(1, &multisampleColor);
+        glDeleteRenderbuffers(1, &multisampleDepth);
+        multisampleFramebuffer = multisampleColor = multisampleDepth = 0;
+    }
+    targetWidth = targetHeight = targetSamples = requestedSamples = 0;
+    complete = false;
+}
+
+bool SceneTarget::resize(int width, int height, int samples)
+{
+    if (!upscaleProgram || width <= 0 || height <= 0)
+    {
+        return false;
+    }
+    if (width == targetWidth && height == targetHeight && samples == requestedSamples)
+    {
+        return complete;
+    }
+    release();
+
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    if (samples > 0)
+    {
+        // The scene is drawn into multisampled renderbuffers and resolved into the texture
+        int maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        targetSamples = samples < maxSamples ? samples : maxSamples;
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+        glGenRenderbuffers(1, &multisampleColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, multisampleColor);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, targetSamples, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &multisampleDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, multisampleDepth);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, targetSamples, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &multisampleFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, multisampleFramebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, multisampleColor);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, multisampleDepth);
+        complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    else
+    {
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+        complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // Remember the request even when incomplete, so a failing one is not retried every frame
+    targetWidth = width;
+    targetHeight = height;
+    requestedSamples = samples;
+    if (!complete)
+    {
+        std::cerr << "Error: Scene framebuffer of " << width << "x" << height << " with " << samples << " samples is incomplete" << std::endl;
+    }
+    return complete;
+}
+
+void SceneTarget::bind() const
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, multisampleFramebuffer ? multisampleFramebuffer : framebuffer);
+    glViewport(0, 0, targetWidth, targetHeight);
+}
+
+void SceneTarget::present(int windowWidth, int windowHeight, float sharpness, bool fxaa) const
+{
+    // The resolve goes to the texture, not the window: a multisampled blit needs identical colour
+    // formats on both sides, and the format of the window is up to the platform
+    if (multisampleFramebuffer)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, multisampleFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glBlitFramebuffer(0, 0, targetWidth, targetHeight, 0, 0, targetWidth, targetHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+    glDisable(GL_DEPTH_TEST);
+    if (fxaa)
+    {
+        glUseProgram(fxaaProgram);
+    }
+    else
+    {
+        glUseProgram(upscaleProgram);
+        bool nativeSize = targetWidth == windowWidth && targetHeight == windowHeight;
+        glUniform1f(sharpnessLoc, nativeSize ? 0.0f : sharpness);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glEnable(GL_DEPTH_TEST);
+}
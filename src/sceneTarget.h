@@ -0,0 +1,67 @@
+#ifndef SCENETARGET_H
+#define SCENETARGET_H
+
+#define SCENE_SHARPNESS 0.6f // strength of the sharpening filter when upscaling
+
+/******************************************************************************/
+/********************************   Scene Target ******************************/
+/******************************************************************************/
+
+enum AntiAliasing
+{
+    AA_NONE,
+    AA_MSAA_2X,
+    AA_MSAA_4X,
+    AA_MSAA_8X,
+    AA_FXAA,
+    AA_MODE_COUNT
+};
+
+extern const char *antiAliasingNames[AA_MODE_COUNT];
+
+// Samples per pixel of the scene target; 0 for the modes without multisampling
+int antiAliasingSamples(AntiAliasing mode);
+
+// Offscreen colour and depth buffers the scene is drawn into, multisampled or at a fraction of the
+// window resolution, then resolved and scaled over the default framebuffer. The UI is drawn afterwards
+// at native resolution.
+class SceneTarget
+{
+public:
+    SceneTarget();
+
+    // Needs a current GL context
+    bool create();
+    void destroy();
+
+    // Make the buffers width x height with samples per pixel (0 for a plain texture); they are only
+    // reallocated when something changes. Returns false when the framebuffer is not usable, in which
+    // case the scene is drawn straight to the window.
+    bool resize(int width, int height, int samples);
+
+    // Draw into the target from here on
+    void bind() const;
+    // Resolve the samples and scale the target over the whole default framebuffer, bilinear, sharpened
+    // when upscaling with sharpness > 0, or through FXAA
+    void present(int windowWidth, int windowHeight, float sharpness, bool fxaa) const;
+
+    int width() const { return targetWidth; }
+    int height() const { return targetHeight; }
+    // Samples per pixel the driver gave; may be fewer than asked for
+    int samples() const { return targetSamples; }
+
+private:
+    SceneTarget(const SceneTarget &);
+    SceneTarget &operator=(const SceneTarget &);
+
+    void release();
+
+    unsigned int framebuffer, colorTexture, depthBuffer;                    // single-sampled; the resolve target with MSAA
+    unsigned int multisampleFramebuffer, multisampleColor, multisampleDepth; // only with MSAA
+    unsigned int upscaleProgram, fxaaProgram, emptyVAO;
+    int sharpnessLoc;
+    int targetWidth, targetHeight, targetSamples, requestedSamples;
+    bool complete;
+};
+
+#endif //SCENETARGET_H
@@ -0,0 +1,385 @@
+#include "session.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "parallel.h"
+#include "profiler.h"
+
+#define SESSION_RECORD_MAX 128 // bytes of the longest record
+#define SESSION_PARAM_FLOATS (sizeof(HarmonographParams) / sizeof(float))
+#ifdef _WIN32
+#define SESSION_NULL_FILE "NUL"
+#else
+#define SESSION_NULL_FILE "/dev/null"
+#endif
+
+///=========================================================================================///
+///                                      Session Recorder
+///=========================================================================================///
+
+SessionRecorder::SessionRecorder() : last(), frames(0), recording(false)
+{
+}
+
+bool SessionRecorder::start(const std::string &filename, float step)
+{
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Could not open session log " << filename << std::endl;
+        return false;
+    }
+    char *out = writer.reserve(SESSION_RECORD_MAX);
+    out = putUInt32LE(out, SESSION_MAGIC);
+    out = putUInt32LE(out, SESSION_VERSION);
+    out = putFloatLE(out, step);
+    writer.commit(out);
+    frames = 0;
+    recording = true;
+    return true;
+}
+
+void SessionRecorder::record(const SessionFrame &frame)
+{
+    if (!recording)
+    {
+        return;
+    }
+
+    // The first frame writes every record, so a log starts from a complete state
+    bool first = frames == 0;
+    if (first || memcmp(&frame.params, &last.params, sizeof(frame.params)) != 0)
+    {
+        char *out = writer.reserve(SESSION_RECORD_MAX);
+        *out++ = SESSION_RECORD_PARAMS;
+        const float *values = &frame.params.amplitude;
+        for (size_t i = 0; i < SESSION_PARAM_FLOATS; ++i)
+        {
+            out = putFloatLE(out, values[i]);
+        }
+        writer.commit(out);
+    }
+    if (first || frame.model != last.model || frame.width != last.width || frame.height != last.height)
+    {
+        char *out = writer.reserve(SESSION_RECORD_MAX);
+        *out++ = SESSION_RECORD_VIEW;
+        for (int c = 0; c < 4; ++c)
+        {
+            for (int r = 0; r < 4; ++r)
+            {
+                out = putFloatLE(out, frame.model[c][r]);
+            }
+        }
+        out = putUInt32LE(out, (uint32_t)frame.width);
+        out = putUInt32LE(out, (uint32_t)frame.height);
+        writer.commit(out);
+    }
+    const ExportSettings &settings = frame.exportSettings, &lastSettings = last.exportSettings;
+    if (first || settings.format != lastSettings.format || settings.optimize != lastSettings.optimize ||
+        settings.precision != lastSettings.precision || settings.quantize != lastSettings.quantize)
+    {
+        char *out = writer.reserve(SESSION_RECORD_MAX);
+        *out++ = SESSION_RECORD_EXPORT;
+        *out++ = (char)settings.format;
+        *out++ = (char)settings.optimize;
+        *out++ = (char)settings.precision;
+        *out++ = (char)settings.quantize;
+        writer.commit(out);
+    }
+
+    char *out = writer.reserve(SESSION_RECORD_MAX);
+    *out++ = SESSION_RECORD_FRAME;
+    out = putFloatLE(out, frame.animationTime);
+    *out++ = (char)((frame.renderSurface ? SESSION_FRAME_SURFACE : 0) | (frame.exportPending ? SESSION_FRAME_EXPORT : 0));
+    writer.commit(out);
+
+    last = frame;
+    ++frames;
+}
+
+bool SessionRecorder::stop()
+{
+    if (!recording)
+    {
+        return true;
+    }
+    recording = false;
+    if (!writer.close())
+    {
+        std::cerr << "Error: Could not write the session log" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+///=========================================================================================///
+///                                       Session Reader
+///=========================================================================================///
+
+// The host is little-endian, as for the curve cache
+static uint32_t getUInt32(const char *in)
+{
+    uint32_t value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+static float getFloat(const char *in)
+{
+    float value;
+    memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+bool SessionReader::open(const std::string &filename)
+{
+    contents.clear();
+    FILE *file = fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        std::cerr << "Error: Could not open session log " << filename << std::endl;
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    contents.resize(length > 0 ? length : 0);
+    bool complete = fread(contents.data(), 1, contents.size(), file) == contents.size();
+    fclose(file);
+
+    if (!complete || contents.size() < 12 || getUInt32(contents.data()) != SESSION_MAGIC || getUInt32(contents.data() + 4) != SESSION_VERSION)
+    {
+        std::cerr << "Error: " << filename << " is not a valid session log\n";
+        contents.clear();
+        return false;
+    }
+    curveStep = getFloat(contents.data() + 8);
+    position = 12;
+    corrupt = false;
+    state = SessionFrame();
+    state.model = glm::mat4(1.0f);
+    return true;
+}
+
+bool SessionReader::next(SessionFrame &frame)
+{
+    while (position < contents.size())
+    {
+        const char *in = contents.data() + position + 1;
+        size_t remaining = contents.size() - position - 1;
+        size_t size;
+        switch (contents[position])
+        {
+        case SESSION_RECORD_PARAMS:
+            size = 4 * SESSION_PARAM_FLOATS;
+            if (remaining >= size)
+            {
+                float *values = &state.params.amplitude;
+                for (size_t i = 0; i < SESSION_PARAM_FLOATS; ++i)
+                {
+                    values[i] = getFloat(in + 4 * i);
+                }
+            }
+            break;
+        case SESSION_RECORD_VIEW:
+            size = 4 * 16 + 8;
+            if (remaining >= size)
+            {
+                for (int i = 0; i < 16; ++i)
+                {
+                    state.model[i / 4][i % 4] = getFloat(in + 4 * i);
+                }
+                state.width = (int)getUInt32(in + 64);
+                state.height = (int)getUInt32(in + 68);
+            }
+            break;
+        case SESSION_RECORD_EXPORT:
+            size = 4;
+            if (remaining >= size && (unsigned char)in[0] < EXPORT_FORMAT_COUNT)
+            {
+                state.exportSettings.format = (ExportFormat)in[0];
+                state.exportSettings.optimize = in[1] != 0;
+                state.exportSettings.precision = in[2];
+                state.exportSettings.quantize = in[3] != 0;
+            }
+            else
+            {
+                size = SIZE_MAX;
+            }
+            break;
+        case SESSION_RECORD_FRAME:
+            size = 5;
+            if (remaining >= size)
+            {
+                state.animationTime = getFloat(in);
+                state.renderSurface = (in[4] & SESSION_FRAME_SURFACE) != 0;
+                state.exportPending = (in[4] & SESSION_FRAME_EXPORT) != 0;
+            }
+            break;
+        default:
+            size = SIZE_MAX;
+            break;
+        }
+
+        if (size > remaining)
+        {
+            std::cerr << "Error: Corrupt session record at byte " << position << std::endl;
+            position = contents.size();
+            corrupt = true;
+            return false;
+        }
+        bool frameEnd = contents[position] == SESSION_RECORD_FRAME;
+        position += 1 + size;
+        if (frameEnd)
+        {
+            frame = state;
+            return true;
+        }
+    }
+    return false;
+}
+
+///=========================================================================================///
+///                                           Replay
+///=========================================================================================///
+
+// FNV-1a, continued from h
+static uint64_t hashBytes(uint64_t h, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i)
+    {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+#define FNV_OFFSET_BASIS 1469598103934665603ull
+
+static double percentile(const std::vector<double> &sorted, double fraction)
+{
+    return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+// The CPU work of drawHarmonograph for every frame, with host memory standing in for the mapped
+// vertex buffers. Exports run in place of the export thread and are timed apart from the frames.
+bool replaySession(const std::string &filename, bool checksums)
+{
+    SessionReader reader;
+    if (!reader.open(filename))
+    {
+        return false;
+    }
+
+    FrameArena arena;
+    std::vector<glm::vec3> curve, meshVertices;
+    std::vector<double> frameTimes;
+    double stageTimes[PROFILE_STAGE_COUNT] = {};
+    uint64_t sessionHash = FNV_OFFSET_BASIS;
+    size_t exports = 0, failedExports = 0;
+    double exportSeconds = 0.0;
+
+    frameProfiler.setEnabled(true);
+    SessionFrame frame;
+    while (reader.next(frame))
+    {
+        frameProfiler.beginFrame();
+        arena.reset();
+
+        // Like drawHarmonograph, a frame that exports builds at the full step whatever step was drawn
+        bool exporting = frame.exportPending && frame.renderSurface;
+        float step = exporting ? HARMONOGRAPH_STEP : reader.step();
+        size_t count = harmonographSampleCount(frame.animationTime, step);
+        ExtrudedMesh mesh(exporting ? nullptr : &arena);
+        curve.resize(count);
+        meshVertices.clear();
+        if (count)
+        {
+            if (frame.renderSurface)
+            {
+                buildExtrudedMesh(frame.params, frame.animationTime, step, mesh);
+            }
+
+            PROFILE_SCOPE(PROFILE_UPLOAD);
+            if (frame.renderSurface)
+            {
+                memcpy(curve.data(), mesh.curve.data(), count * sizeof(glm::vec3));
+            }
+            else
+            {
+                evaluateHarmonograph(frame.params, step, count, curve.data());
+            }
+            if (!mesh.indices.empty())
+            {
+                meshVertices.resize(mesh.indices.size() * 2);
+                interleaveExtrudedMesh(mesh, meshVertices.data());
+            }
+        }
+        frameProfiler.endFrame();
+
+        const ProfileFrame &profile = frameProfiler.frame(0);
+        frameTimes.push_back(profile.frameTime);
+        for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+        {
+            stageTimes[s] += profile.cpu[s];
+        }
+
+        if (checksums)
+        {
+            uint64_t h = hashBytes(FNV_OFFSET_BASIS, curve.data(), curve.size() * sizeof(glm::vec3));
+            h = hashBytes(h, meshVertices.data(), meshVertices.size() * sizeof(glm::vec3));
+            sessionHash = hashBytes(sessionHash, &h, sizeof(h));
+            printf("frame %zu %016llx\n", frameTimes.size() - 1, (unsigned long long)h);
+        }
+
+        if (exporting && !mesh.indices.empty())
+        {
+            uint64_t start = traceClock();
+            ExportMesh exportGeometry;
+            bool exported = buildExportMesh(mesh, exportGeometry, frame.exportSettings.optimize) &&
+                            exportMesh(exportGeometry, SESSION_NULL_FILE, frame.exportSettings);
+            exportSeconds += (traceClock() - start) * 1e-9;
+            ++exports;
+            failedExports += exported ? 0 : 1;
+        }
+    }
+    frameProfiler.setEnabled(false);
+
+    if (frameTimes.empty())
+    {
+        std::cerr << "Error: " << filename << " holds no frames\n";
+        return false;
+    }
+
+    std::vector<double> sorted(frameTimes);
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (double t : frameTimes)
+    {
+        total += t;
+    }
+    size_t frames = frameTimes.size();
+    printf("%zu frames, %u threads, %.3f s\n", frames, parallelThreadCount(), total);
+    printf("frame ms: mean %.3f, median %.3f, p95 %.3f, p99 %.3f, max %.3f\n", 1e3 * total / frames, 1e3 * percentile(sorted, 0.5),
+           1e3 * percentile(sorted, 0.95), 1e3 * percentile(sorted, 0.99), 1e3 * sorted.back());
+    printf("stage ms per frame:");
+    for (int s = 0; s < PROFILE_STAGE_COUNT; ++s)
+    {
+        if (stageTimes[s] > 0.0)
+        {
+            printf(" %s %.3f", profileStageNames[s], 1e3 * stageTimes[s] / frames);
+        }
+    }
+    printf("\n");
+    if (exports)
+    {
+        printf("%zu exports (%zu failed), %.3f s\n", exports, failedExports, exportSeconds);
+    }
+    if (checksums)
+    {
+        printf("checksum %016llx\n", (unsigned long long)sessionHash);
+    }
+    return reader.good();
+}
@@ -0,0 +1,100 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bufferedWriter.h"
+#include "geometry.h"
+#include "meshExport.h"
+
+#define SESSION_MAGIC 0x53474848 // "HHGS" in the first four bytes of the file
+#define SESSION_VERSION 1
+#define SESSION_EXTENSION "hgs"
+
+/******************************************************************************/
+/*******************************   Session Log ********************************/
+/******************************************************************************/
+
+// Log layout: magic, version and the curve step, then records of a one-byte type. A frame is the
+// records of what changed since the frame before it, followed by SESSION_RECORD_FRAME. Little-endian,
+// like the curve cache; a big-endian host reads a wrong magic and rejects the log.
+enum SessionRecord
+{
+    SESSION_RECORD_PARAMS = 1, // HarmonographParams: edits in the UI, presets and opened designs
+    SESSION_RECORD_VIEW,       // model matrix (16 floats) after mouse input, framebuffer width and height
+    SESSION_RECORD_EXPORT,     // export format, optimize, precision and quantize (one byte each)
+    SESSION_RECORD_FRAME       // animation time (float) and SESSION_FRAME_* flags (one byte)
+};
+
+enum SessionFrameFlags
+{
+    SESSION_FRAME_SURFACE = 1, // the extruded surface is drawn
+    SESSION_FRAME_EXPORT = 2   // an Export press is waiting for the surface
+};
+
+// Everything a frame of the render loop does its work from
+struct SessionFrame
+{
+    HarmonographParams params;
+    float animationTime;
+    bool renderSurface;
+    bool exportPending;
+    ExportSettings exportSettings;
+    glm::mat4 model;
+    int width, height;
+};
+
+// Appends the inputs of every frame to a log, writing only what changed
+class SessionRecorder
+{
+public:
+    SessionRecorder();
+
+    bool start(const std::string &filename, float step);
+    void record(const SessionFrame &frame);
+    bool stop();
+    bool isRecording() const { return recording; }
+    uint64_t frameCount() const { return frames; }
+
+private:
+    SessionRecorder(const SessionRecorder &);
+    SessionRecorder &operator=(const SessionRecorder &);
+
+    BufferedWriter writer;
+    SessionFrame last;
+    uint64_t frames;
+    bool recording;
+};
+
+// Reads a log back frame by frame
+class SessionReader
+{
+public:
+    SessionReader() : position(0), curveStep(0.0f), state(), corrupt(false) {}
+
+    bool open(const std::string &filename);
+    float step() const { return curveStep; }
+
+    // The inputs of the next frame; false at the end of the log or, reported on stderr, at a corrupt record
+    bool next(SessionFrame &frame);
+    // False once a corrupt record was found
+    bool good() const { return !corrupt; }
+
+private:
+    std::vector<char> contents;
+    size_t position;
+    float curveStep;
+    SessionFrame state;
+    bool corrupt;
+};
+
+// Run the frames of a log without a window as fast as they go and print timing statistics. With
+// checksums, a hash of the geometry of every frame is printed too, so two builds can be compared.
+bool replaySession(const std::string &filename, bool checksums);
+
+#endif //SESSION_H
@@ -0,0 +1,232 @@
+#include "traceRecorder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+///=========================================================================================///
+///                                      Trace Recorder
+///=========================================================================================///
+
+#define TRACE_EVENT_MAX 160 // longest text of one event, not counting the name
+
+TraceRecorder traceRecorder;
+
+static thread_local TraceThreadBuffer *localBuffer = nullptr;
+static thread_local const char *localName = nullptr;
+
+static char *appendText(char *out, const char *text, size_t size)
+{
+    memcpy(out, text, size);
+    return out + size;
+}
+
+#define APPEND_LITERAL(out, text) appendText(out, text, sizeof(text) - 1)
+
+uint64_t traceClock()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+TraceRecorder::TraceRecorder()
+    : recording(false), written(0), dropped(0), epoch(0), stopping(false), firstEvent(true)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    stop();
+    for (TraceThreadBuffer *buffer : buffers)
+    {
+        delete buffer;
+    }
+}
+
+bool TraceRecorder::start(const std::string &filename)
+{
+    if (isRecording())
+    {
+        return true;
+    }
+    if (!writer.open(filename))
+    {
+        std::cerr << "Error: Could not open trace file " << filename << std::endl;
+        return false;
+    }
+
+    // Events left from an earlier recording are dropped; a scope that was still open when it ended
+    // may add one more, which the epoch leaves out
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (TraceThreadBuffer *buffer : buffers)
+        {
+            buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+        }
+        stopping = false;
+    }
+    written = 0;
+    dropped = 0;
+    epoch = traceClock();
+    firstEvent = true;
+    writer.write("[\n", 2);
+
+    flusher = std::thread(&TraceRecorder::flushLoop, this);
+    recording.store(true, std::memory_order_release);
+    return true;
+}
+
+bool TraceRecorder::stop()
+{
+    if (!isRecording())
+    {
+        return true;
+    }
+    recording.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    flusher.join();
+
+    // Thread names go last, once every thread that recorded has its buffer
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (TraceThreadBuffer *buffer : buffers)
+        {
+            const char *name = buffer->name.load(std::memory_order_acquire);
+            if (!name)
+            {
+                continue;
+            }
+            size_t size = TRACE_EVENT_MAX + strlen(name);
+            char *out = writer.reserve(size);
+            out += snprintf(out, size, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                            firstEvent ? "" : ",\n", buffer->id, name);
+            writer.commit(out);
+            firstEvent = false;
+        }
+    }
+    writer.write("\n]\n", 3);
+
+    if (!writer.close())
+    {
+        std::cerr << "Error: Could not write the trace file" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void TraceRecorder::record(const char *name, uint64_t start, uint64_t end)
+{
+    TraceThreadBuffer *buffer = threadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    if (head - buffer->tail.load(std::memory_order_acquire) >= TRACE_BUFFER_EVENTS)
+    {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    TraceEvent &event = buffer->events[head % TRACE_BUFFER_EVENTS];
+    event.name = name;
+    event.start = start;
+    event.duration = end - start;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void TraceRecorder::setThreadName(const char *name)
+{
+    localName = name;
+    if (localBuffer)
+    {
+        localBuffer->name.store(name, std::memory_order_release);
+    }
+}
+
+// The buffer of the calling thread, registered when the thread records its first event
+TraceThreadBuffer *TraceRecorder::threadBuffer()
+{
+    if (!localBuffer)
+    {
+        TraceThreadBuffer *buffer = new TraceThreadBuffer;
+        buffer->head.store(0, std::memory_order_relaxed);
+        buffer->tail.store(0, std::memory_order_relaxed);
+        buffer->name.store(localName, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        buffer->id = (unsigned int)buffers.size() + 1;
+        buffers.push_back(buffer);
+        localBuffer = buffer;
+    }
+    return localBuffer;
+}
+
+void TraceRecorder::flushLoop()
+{
+    for (;;)
+    {
+        bool last;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait_for(lock, std::chrono::milliseconds(TRACE_FLUSH_INTERVAL_MS), [this]
+                          { return stopping; });
+            last = stopping;
+        }
+
+        drain();
+        // Written out every interval, so a session that crashes still leaves a readable trace
+        writer.flush();
+        if (last)
+        {
+            return;
+        }
+    }
+}
+
+void TraceRecorder::drain()
+{
+    std::vector<TraceThreadBuffer *> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = buffers;
+    }
+
+    uint64_t count = 0;
+    for (TraceThreadBuffer *buffer : current)
+    {
+        uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail)
+        {
+            const TraceEvent &event = buffer->events[tail % TRACE_BUFFER_EVENTS];
+            if (event.start < epoch)
+            {
+                continue;
+            }
+
+            // Microseconds with nanosecond decimals, relative to the start of the recording
+            size_t nameLength = strlen(event.name);
+            char *out = writer.reserve(TRACE_EVENT_MAX + nameLength);
+            if (!firstEvent)
+            {
+                *out++ = ',';
+                *out++ = '\n';
+            }
+            out = APPEND_LITERAL(out, "{\"name\":\"");
+            out = appendText(out, event.name, nameLength);
+            out = APPEND_LITERAL(out, "\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            out = formatUInt(out, buffer->id);
+            out = APPEND_LITERAL(out, ",\"ts\":");
+            out = formatFixed(out, (int64_t)(event.start - epoch), 3);
+            out = APPEND_LITERAL(out, ",\"dur\":");
+            out = formatFixed(out, (int64_t)event.duration, 3);
+            *out++ = '}';
+            writer.commit(out);
+            firstEvent = false;
+            ++count;
+        }
+        buffer->tail.store(head, std::memory_order_release);
+    }
+    written.fetch_add(count, std::memory_order_relaxed);
+}
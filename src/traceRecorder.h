@@ -0,0 +1,112 @@
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bufferedWriter.h"
+
+#define TRACE_BUFFER_EVENTS 65536   // events each thread can hold before the flusher drains them
+#define TRACE_FLUSH_INTERVAL_MS 100 // how often the flusher drains the thread buffers
+
+/******************************************************************************/
+/*******************************   Trace Recorder *****************************/
+/******************************************************************************/
+
+// Nanoseconds of a steady clock, the time base of trace events
+uint64_t traceClock();
+
+struct TraceEvent
+{
+    const char *name; // must outlive the recording: a string literal or profileStageNames
+    uint64_t start;   // traceClock
+    uint64_t duration;
+};
+
+// Single-producer ring of one thread: the thread advances head, the flusher advances tail
+struct TraceThreadBuffer
+{
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+    std::atomic<uint64_t> head, tail;
+    std::atomic<const char *> name;
+    unsigned int id;
+};
+
+// Writes timed scopes of any thread as Chrome trace events (JSON array format), which chrome://tracing
+// and Perfetto open. Recording threads never lock or wait: each writes into a ring of its own and a
+// background thread drains the rings to the file. Events of a full ring are dropped and counted.
+// While not recording a scope costs one relaxed atomic load.
+class TraceRecorder
+{
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    // Start and stop from one thread, usually the render thread
+    bool start(const std::string &filename);
+    bool stop();
+    bool isRecording() const { return recording.load(std::memory_order_relaxed); }
+
+    void record(const char *name, uint64_t start, uint64_t end);
+    // Name the calling thread in the viewer; name must be a string literal
+    void setThreadName(const char *name);
+
+    // Of the current or last recording
+    uint64_t eventsWritten() const { return written.load(std::memory_order_relaxed); }
+    uint64_t eventsDropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    TraceRecorder(const TraceRecorder &);
+    TraceRecorder &operator=(const TraceRecorder &);
+
+    TraceThreadBuffer *threadBuffer();
+    void flushLoop();
+    void drain();
+
+    std::atomic<bool> recording;
+    std::atomic<uint64_t> written, dropped;
+    uint64_t epoch; // events that started before the recording are left out
+
+    std::mutex mutex; // guards buffers and stopping
+    std::condition_variable wake;
+    std::vector<TraceThreadBuffer *> buffers;
+    bool stopping;
+    std::thread flusher;
+    BufferedWriter writer; // used by the flusher while recording
+    bool firstEvent;
+};
+
+extern TraceRecorder traceRecorder;
+
+// Records the rest of the enclosing block as an event while a trace is recording
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name) : name(name), start(traceRecorder.isRecording() ? traceClock() : 0) {}
+    ~TraceScope()
+    {
+        if (start)
+        {
+            traceRecorder.record(name, start, traceClock());
+        }
+    }
+
+private:
+    TraceScope(const TraceScope &);
+    TraceScope &operator=(const TraceScope &);
+
+    const char *name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif //TRACERECORDER_H